@@ -0,0 +1,75 @@
+#include "ipc.h"
+#include "ipc_context.h"
+#include "ipc_frame.h"
+#include <string.h>
+
+
+// Ожидание сообщения барьера от from. Чужие сообщения, пришедшие раньше,
+// откладываются для receive()/receive_any()
+static int wait_barrier_token(IPC *ipc, local_id from) {
+    Message msg;
+    FrameExt ext;
+
+    while (ipc->barrier_pending[from] == 0) {
+        int rc = receive_frame(ipc, from, &msg, &ext);
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc > 0) {
+            continue;
+        }
+
+        if (ext.s_flags & FRAME_BARRIER) {
+            ipc->barrier_pending[from]++;
+        } else if (defer_message(ipc, from, &msg) != 0) {
+            return -1;
+        }
+    }
+
+    ipc->barrier_pending[from]--;
+    return 0;
+}
+
+int ipc_barrier(void *self, MessageType type, const char *payload, uint16_t payload_len) {
+    IPC *ipc = (IPC *)self;
+    int n = ipc->process_count;
+
+    // Партнеры раундов - любые пары процессов
+    if (payload_len > MAX_EXT_PAYLOAD_LEN || !ipc_topology_complete(n)) {
+        return -1;
+    }
+
+    Message msg;
+    msg.s_header.s_magic = MESSAGE_MAGIC;
+    msg.s_header.s_type = type;
+    msg.s_header.s_payload_len = payload ? payload_len : 0;
+    msg.s_header.s_local_time = 0;
+    if (payload) {
+        memcpy(msg.s_payload, payload, payload_len);
+    }
+
+    FrameExt ext;
+    ext.s_flags = FRAME_BARRIER | frame_default_flags(ipc);
+    ext.s_origin = ipc->id;
+    ext.s_seq = ++ipc->barrier_epoch;
+
+    Message frame;
+    if (wrap_frame(&msg, &ext, &frame) != 0) {
+        return -1;
+    }
+
+    // Раунд с шагом dist: после него процесс знает о всех 2*dist предшественниках
+    for (int dist = 1; dist < n; dist <<= 1) {
+        local_id to = (ipc->id + dist) % n;
+        local_id from = (ipc->id - dist + n) % n;
+
+        if (write_frame(ipc, to, &frame) != 0) {
+            return -1;
+        }
+        if (wait_barrier_token(ipc, from) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
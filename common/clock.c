@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "clock.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CLOCK_HAVE_TSC 1
+#endif
+
+
+enum {
+    TSC_CALIBRATION_NS = 10000000
+};
+
+// Начальная настройка (clock_start_ns, IPC_CLOCK) - ровно один раз на процесс,
+// даже если часы впервые читают несколько потоков сразу
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static ClockSource clock_source = CLOCK_SOURCE_MONOTONIC;
+static uint64_t clock_start_ns;
+
+// Пересчет тактов TSC в наносекунды: ns = base_ns + (tsc - base_tsc) * mult >> 32
+static uint64_t tsc_base;
+static uint64_t tsc_base_ns;
+static uint64_t tsc_mult;
+
+int clock_raw_tsc = 0;
+static pthread_once_t clock_raw_once = PTHREAD_ONCE_INIT;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef CLOCK_HAVE_TSC
+static int tsc_invariant(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (edx >> 8) & 1;
+}
+
+static int tsc_calibrate(void) {
+    if (!tsc_invariant()) {
+        return -1;
+    }
+
+    uint64_t t0 = monotonic_ns();
+    uint64_t c0 = __rdtsc();
+    uint64_t t1;
+    do {
+        t1 = monotonic_ns();
+    } while (t1 - t0 < TSC_CALIBRATION_NS);
+    uint64_t c1 = __rdtsc();
+
+    if (c1 <= c0) {
+        return -1;
+    }
+
+    tsc_mult = (uint64_t)(((unsigned __int128)(t1 - t0) << 32) / (c1 - c0));
+    tsc_base = c1;
+    tsc_base_ns = t1;
+    return 0;
+}
+
+static uint64_t tsc_to_ns(uint64_t tsc) {
+    return tsc_base_ns + (uint64_t)(((unsigned __int128)(tsc - tsc_base) * tsc_mult) >> 32);
+}
+#endif
+
+static int select_source(ClockSource source) {
+    if (source == CLOCK_SOURCE_TSC) {
+#ifdef CLOCK_HAVE_TSC
+        if (tsc_calibrate() == 0) {
+            clock_source = CLOCK_SOURCE_TSC;
+            return 0;
+        }
+#endif
+        return -1;
+    }
+
+    clock_source = CLOCK_SOURCE_MONOTONIC;
+    return 0;
+}
+
+static void clock_init(void) {
+    clock_start_ns = monotonic_ns();
+
+    const char *source = getenv("IPC_CLOCK");
+    if (source && strcmp(source, "tsc") == 0) {
+        select_source(CLOCK_SOURCE_TSC);
+    }
+}
+
+int clock_select(ClockSource source) {
+    pthread_once(&clock_once, clock_init);
+    return select_source(source);
+}
+
+uint64_t clock_now_ns(void) {
+    pthread_once(&clock_once, clock_init);
+
+#ifdef CLOCK_HAVE_TSC
+    if (clock_source == CLOCK_SOURCE_TSC) {
+        return tsc_to_ns(__rdtsc());
+    }
+#endif
+
+    return monotonic_ns();
+}
+
+static void clock_raw_calibrate(void) {
+    pthread_once(&clock_once, clock_init);
+#ifdef CLOCK_HAVE_TSC
+    // С IPC_CLOCK=tsc калибровка уже сделана
+    clock_raw_tsc = clock_source == CLOCK_SOURCE_TSC || tsc_calibrate() == 0;
+#endif
+}
+
+void clock_raw_init(void) {
+    pthread_once(&clock_raw_once, clock_raw_calibrate);
+}
+
+uint64_t clock_raw_to_ns(uint64_t raw) {
+#ifdef CLOCK_HAVE_TSC
+    if (clock_raw_tsc) {
+        return tsc_to_ns(raw);
+    }
+#endif
+    return raw;
+}
+
+timestamp_t clock_emulated_time(void) {
+    // clock_now_ns() читается первым: он же и задает clock_start_ns
+    uint64_t now = clock_now_ns();
+    uint64_t ticks = (now - clock_start_ns) / CLOCK_TICK_NS;
+    return ticks > CLOCK_MAX_TICK ? CLOCK_MAX_TICK : (timestamp_t)ticks;
+}
@@ -0,0 +1,67 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "ipc.h"
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Источник времени для измерений задержек. get_physical_time() из libruntime
+// отдает int16_t тик, насыщающийся на MAX_T, - для измерений он не годится.
+
+typedef enum {
+    CLOCK_SOURCE_MONOTONIC = 0,  ///< clock_gettime(CLOCK_MONOTONIC), через vDSO без системного вызова
+    CLOCK_SOURCE_TSC             ///< rdtsc, откалиброванный по CLOCK_MONOTONIC
+} ClockSource;
+
+enum {
+    CLOCK_TICK_NS = 1000000,  ///< длительность одного эмулируемого тика
+    CLOCK_MAX_TICK = 255      ///< совпадает с MAX_T из banking.h
+};
+
+/** Выбрать источник для clock_now_ns().
+ *
+ * Переменная окружения IPC_CLOCK=tsc выбирает TSC при первом обращении.
+ *
+ * @return 0 on success, -1 если TSC не инвариантен или недоступен
+ *         (тогда остается CLOCK_MONOTONIC)
+ */
+int clock_select(ClockSource source);
+
+/** Монотонное время в наносекундах, общее для всех процессов на машине.
+ * Первый вызов в процессе (из любого потока) настраивает часы.
+ */
+uint64_t clock_now_ns(void);
+
+/** Эмуляция get_physical_time(): тики CLOCK_TICK_NS с первого обращения
+ * к часам в процессе, не больше CLOCK_MAX_TICK.
+ */
+timestamp_t clock_emulated_time(void);
+
+/// Что отдает clock_raw(): 1 - такты TSC, 0 - clock_now_ns()
+extern int clock_raw_tsc;
+
+/** Подготовить clock_raw(): откалибровать TSC, если он инвариантен.
+ * Калибровка (~10 мс) делается один раз на процесс; вызывать можно из
+ * любого потока.
+ */
+void clock_raw_init(void);
+
+/** Сырая метка для горячих путей: такты TSC без пересчета в наносекунды,
+ * без TSC - clock_now_ns(). Переводит в наносекунды clock_raw_to_ns().
+ */
+static inline uint64_t clock_raw(void) {
+#if defined(__x86_64__)
+    if (clock_raw_tsc) {
+        return __rdtsc();
+    }
+#endif
+    return clock_now_ns();
+}
+
+/** Метка clock_raw() в шкале clock_now_ns().
+ */
+uint64_t clock_raw_to_ns(uint64_t raw);
+
+#endif // CLOCK_H
@@ -0,0 +1,169 @@
+#include "compress.h"
+#include <stdint.h>
+#include <string.h>
+
+
+enum {
+    LZ_HASH_BITS = 12,
+    LZ_MAX_OFFSET = 0xFFFF
+};
+
+static uint32_t lz_hash(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Длина сверх 15 в тетраде: байты 255 и остаток
+static unsigned char *put_length(unsigned char *out, const unsigned char *out_end, size_t len) {
+    while (len >= 255) {
+        if (out >= out_end) {
+            return NULL;
+        }
+        *out++ = 255;
+        len -= 255;
+    }
+    if (out >= out_end) {
+        return NULL;
+    }
+    *out++ = (unsigned char)len;
+    return out;
+}
+
+static unsigned char *put_sequence(unsigned char *out, const unsigned char *out_end,
+                                   const unsigned char *lit, size_t lit_len,
+                                   size_t offset, size_t match_len) {
+    if (out >= out_end) {
+        return NULL;
+    }
+    unsigned char *token = out++;
+    size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *token = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+    
+    if (lit_len >= 15 && !(out = put_length(out, out_end, lit_len - 15))) {
+        return NULL;
+    }
+    if ((size_t)(out_end - out) < lit_len) {
+        return NULL;
+    }
+    memcpy(out, lit, lit_len);
+    out += lit_len;
+    
+    // Последняя последовательность - только литералы
+    if (match_len == 0) {
+        return out;
+    }
+    if (out_end - out < 2) {
+        return NULL;
+    }
+    *out++ = (unsigned char)offset;
+    *out++ = (unsigned char)(offset >> 8);
+    if (match_code >= 15 && !(out = put_length(out, out_end, match_code - 15))) {
+        return NULL;
+    }
+    return out;
+}
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap) {
+    const unsigned char *in = src;
+    const unsigned char *in_end = in + len;
+    unsigned char *out = dst;
+    unsigned char *out_end = out + cap;
+    uint16_t table[1 << LZ_HASH_BITS];
+    
+    // Позиции храним со сдвигом на 1: 0 - пустая ячейка
+    memset(table, 0, sizeof(table));
+    
+    const unsigned char *anchor = in;
+    const unsigned char *pos = in;
+    while (len >= LZ_MIN_MATCH && pos + LZ_MIN_MATCH <= in_end) {
+        uint32_t h = lz_hash(pos);
+        const unsigned char *ref = table[h] ? in + table[h] - 1 : NULL;
+        table[h] = (uint16_t)(pos - in + 1);
+        
+        if (!ref || pos - ref > LZ_MAX_OFFSET || memcmp(ref, pos, LZ_MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+        
+        size_t match_len = LZ_MIN_MATCH;
+        while (pos + match_len < in_end && ref[match_len] == pos[match_len]) {
+            match_len++;
+        }
+        
+        out = put_sequence(out, out_end, anchor, pos - anchor, pos - ref, match_len);
+        if (!out) {
+            return 0;
+        }
+        pos += match_len;
+        anchor = pos;
+    }
+    
+    out = put_sequence(out, out_end, anchor, in_end - anchor, 0, 0);
+    if (!out || out == out_end) {
+        return 0;
+    }
+    return out - (unsigned char *)dst;
+}
+
+// Чтение продолжения длины; -1 если поток оборвался
+static int get_length(const unsigned char **in, const unsigned char *in_end, size_t *len) {
+    unsigned char byte;
+    do {
+        if (*in >= in_end) {
+            return -1;
+        }
+        byte = *(*in)++;
+        *len += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+ssize_t lz_decompress(const void *src, size_t len, void *dst, size_t cap) {
+    const unsigned char *in = src;
+    const unsigned char *in_end = in + len;
+    unsigned char *out = dst;
+    unsigned char *out_end = out + cap;
+    
+    while (in < in_end) {
+        unsigned char token = *in++;
+        
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && get_length(&in, in_end, &lit_len) != 0) {
+            return -1;
+        }
+        if ((size_t)(in_end - in) < lit_len || (size_t)(out_end - out) < lit_len) {
+            return -1;
+        }
+        memcpy(out, in, lit_len);
+        in += lit_len;
+        out += lit_len;
+        
+        if (in == in_end) {
+            break;
+        }
+        
+        if (in_end - in < 2) {
+            return -1;
+        }
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && get_length(&in, in_end, &match_len) != 0) {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+        
+        if (offset == 0 || offset > (size_t)(out - (unsigned char *)dst) ||
+            (size_t)(out_end - out) < match_len) {
+            return -1;
+        }
+        // Побайтно: совпадение может перекрывать то, что сейчас пишется
+        const unsigned char *ref = out - offset;
+        while (match_len--) {
+            *out++ = *ref++;
+        }
+    }
+    
+    return out - (unsigned char *)dst;
+}
@@ -0,0 +1,30 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Быстрое LZ-сжатие для payload. Поток - последовательность
+// [токен][литералы][смещение][длина совпадения]: старшая тетрада токена -
+// число литералов, младшая - длина совпадения минус LZ_MIN_MATCH, значение 15
+// продолжается байтами до первого < 255. Совпадение может перекрывать
+// собственный выход, поэтому серии одинаковых байт кодируются как RLE.
+
+enum {
+    LZ_MIN_MATCH = 4
+};
+
+/** Сжать src[0..len) в dst.
+ *
+ * @return длина сжатых данных или 0, если они не короче cap
+ */
+size_t lz_compress(const void * src, size_t len, void * dst, size_t cap);
+
+/** Распаковать src[0..len) в dst.
+ *
+ * @return длина распакованных данных или -1, если поток испорчен
+ *         или не помещается в cap
+ */
+ssize_t lz_decompress(const void * src, size_t len, void * dst, size_t cap);
+
+#endif // COMPRESS_H
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+
+#include "coroutine.h"
+#include "clock.h"
+#include "ipc_context.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+
+enum {
+    MAX_WORKERS = 64,
+    IDLE_SLEEP_MS = 1    // простой потока; заодно шаг проверки таймаутов
+};
+
+// Состояние сопрограммы. RUNNING - выполняется или стоит в очереди,
+// NOTIFIED - разбудили, пока она еще не успела уснуть
+enum {
+    CO_RUNNING = 0,
+    CO_PARKED,
+    CO_NOTIFIED,
+    CO_DONE
+};
+
+struct Coroutine {
+    ucontext_t ctx;
+    char *stack;            // с защитной страницей снизу
+    size_t stack_size;
+    IPC *ipc;
+    int state;
+    int park_request;       // сопрограмма уступила поток, чтобы уснуть
+    int64_t deadline_ns;
+    int rc;
+    struct Worker *worker;  // поток, который выполняет ее сейчас
+};
+
+// Очередь готовых: владелец берет с конца, воры - с начала
+typedef struct {
+    pthread_mutex_t lock;
+    Coroutine *items[MAX_PROCESS_ID + 1];
+    int head;
+    int count;
+} RunQueue;
+
+typedef struct Worker {
+    ucontext_t ctx;
+    pthread_t thread;
+    RunQueue queue;
+    int index;
+    Scheduler *sched;
+} Worker;
+
+struct Scheduler {
+    Coroutine nodes[MAX_PROCESS_ID + 1];
+    int node_count;
+    Worker workers[MAX_WORKERS];
+    int worker_count;
+    int remaining;
+    ThreadEntry entry;
+    void *arg;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    int idle;
+};
+
+static __thread Worker *current_worker = NULL;
+static __thread Coroutine *current_co = NULL;
+
+// Сопрограмма может продолжиться на другом потоке: адрес __thread-переменной
+// нельзя кэшировать через swapcontext(), поэтому чтение - отдельной функцией
+__attribute__((noinline)) Coroutine *coroutine_current(void) {
+    return current_co;
+}
+
+IPC *coroutine_ipc(Coroutine *co) {
+    return co->ipc;
+}
+
+static void queue_push(RunQueue *q, Coroutine *co) {
+    pthread_mutex_lock(&q->lock);
+    q->items[(q->head + q->count) % (MAX_PROCESS_ID + 1)] = co;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static Coroutine *queue_pop(RunQueue *q) {
+    Coroutine *co = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        q->count--;
+        co = q->items[(q->head + q->count) % (MAX_PROCESS_ID + 1)];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return co;
+}
+
+static Coroutine *queue_steal(RunQueue *q) {
+    Coroutine *co = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        co = q->items[q->head];
+        q->head = (q->head + 1) % (MAX_PROCESS_ID + 1);
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return co;
+}
+
+// Поставить готовую сопрограмму в очередь: к текущему потоку, чтобы
+// получатель шел там же, где отправитель, и данные были в его кэше
+static void schedule(Scheduler *sched, Coroutine *co) {
+    Worker *worker = current_worker ? current_worker : &sched->workers[0];
+    queue_push(&worker->queue, co);
+
+    if (__atomic_load_n(&sched->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&sched->idle_lock);
+        pthread_cond_signal(&sched->idle_cond);
+        pthread_mutex_unlock(&sched->idle_lock);
+    }
+}
+
+void scheduler_wake(Scheduler *sched, local_id id) {
+    Coroutine *co = &sched->nodes[id];
+
+    while (1) {
+        int state = __atomic_load_n(&co->state, __ATOMIC_SEQ_CST);
+        if (state == CO_PARKED) {
+            if (__atomic_compare_exchange_n(&co->state, &state, CO_RUNNING, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                schedule(sched, co);
+                return;
+            }
+        } else if (state == CO_RUNNING) {
+            if (__atomic_compare_exchange_n(&co->state, &state, CO_NOTIFIED, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+void coroutine_park(Coroutine *co, int64_t deadline_ns) {
+    co->deadline_ns = deadline_ns;
+    co->park_request = 1;
+    // Засыпание оформляет поток после переключения - иначе нас могли бы
+    // разбудить и запустить на другом потоке, пока мы еще на своем стеке
+    swapcontext(&co->ctx, &co->worker->ctx);
+}
+
+static void coroutine_main(void) {
+    Coroutine *co = coroutine_current();
+    Scheduler *sched = co->worker->sched;
+
+    co->rc = sched->entry(co->ipc, co->ipc->id, sched->arg);
+    __atomic_store_n(&co->state, CO_DONE, __ATOMIC_SEQ_CST);
+
+    swapcontext(&co->ctx, &co->worker->ctx);
+}
+
+static void coroutine_init(Coroutine *co, IPC *ipc) {
+    long page = sysconf(_SC_PAGESIZE);
+
+    co->ipc = ipc;
+    co->state = CO_RUNNING;
+    co->park_request = 0;
+    co->deadline_ns = -1;
+    co->rc = -1;
+    co->worker = NULL;
+
+    co->stack_size = COROUTINE_STACK_SIZE + page;
+    co->stack = mmap(NULL, co->stack_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (co->stack == MAP_FAILED) {
+        perror("mmap coroutine stack failed");
+        exit(1);
+    }
+    // Переполнение стека - SIGSEGV, а не порча соседней сопрограммы
+    mprotect(co->stack, page, PROT_NONE);
+
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack + page;
+    co->ctx.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    co->ctx.uc_link = NULL;
+    makecontext(&co->ctx, coroutine_main, 0);
+}
+
+// Проснуть сопрограммы, у которых вышел таймаут ожидания
+static void expire_timers(Scheduler *sched) {
+    int64_t now = (int64_t)clock_now_ns();
+
+    for (int i = 0; i < sched->node_count; i++) {
+        Coroutine *co = &sched->nodes[i];
+        int state = CO_PARKED;
+        if (__atomic_load_n(&co->state, __ATOMIC_SEQ_CST) == CO_PARKED &&
+            co->deadline_ns >= 0 && now >= co->deadline_ns &&
+            __atomic_compare_exchange_n(&co->state, &state, CO_RUNNING, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            schedule(sched, co);
+        }
+    }
+}
+
+static Coroutine *find_work(Worker *worker) {
+    Scheduler *sched = worker->sched;
+
+    Coroutine *co = queue_pop(&worker->queue);
+    for (int k = 1; !co && k < sched->worker_count; k++) {
+        co = queue_steal(&sched->workers[(worker->index + k) % sched->worker_count].queue);
+    }
+    return co;
+}
+
+static void run(Worker *worker, Coroutine *co) {
+    Scheduler *sched = worker->sched;
+
+    co->worker = worker;
+    co->park_request = 0;
+    current_co = co;
+    swapcontext(&worker->ctx, &co->ctx);
+    current_co = NULL;
+
+    int state = CO_RUNNING;
+    if (__atomic_load_n(&co->state, __ATOMIC_SEQ_CST) == CO_DONE) {
+        if (__atomic_sub_fetch(&sched->remaining, 1, __ATOMIC_SEQ_CST) == 0) {
+            pthread_mutex_lock(&sched->idle_lock);
+            pthread_cond_broadcast(&sched->idle_cond);
+            pthread_mutex_unlock(&sched->idle_lock);
+        }
+        return;
+    }
+
+    if (co->park_request &&
+        __atomic_compare_exchange_n(&co->state, &state, CO_PARKED, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    // Разбудили до засыпания - сразу снова в очередь
+    __atomic_store_n(&co->state, CO_RUNNING, __ATOMIC_SEQ_CST);
+    queue_push(&worker->queue, co);
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Scheduler *sched = worker->sched;
+    current_worker = worker;
+
+    while (__atomic_load_n(&sched->remaining, __ATOMIC_SEQ_CST) > 0) {
+        Coroutine *co = find_work(worker);
+        if (co) {
+            run(worker, co);
+            continue;
+        }
+
+        expire_timers(sched);
+        if ((co = find_work(worker)) != NULL) {
+            run(worker, co);
+            continue;
+        }
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += IDLE_SLEEP_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&sched->idle_lock);
+        __atomic_add_fetch(&sched->idle, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&sched->remaining, __ATOMIC_SEQ_CST) > 0) {
+            pthread_cond_timedwait(&sched->idle_cond, &sched->idle_lock, &until);
+        }
+        __atomic_sub_fetch(&sched->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&sched->idle_lock);
+    }
+
+    current_worker = NULL;
+    return NULL;
+}
+
+int ipc_run_coroutines(int process_count, int workers, ThreadEntry entry, void *arg) {
+    if (process_count <= 0 || process_count > MAX_PROCESS_ID + 1) {
+        return -1;
+    }
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > MAX_WORKERS) {
+        workers = MAX_WORKERS;
+    }
+    if (workers > process_count) {
+        workers = process_count;
+    }
+
+    if (prepare_shared_logs() != 0) {
+        return -1;
+    }
+
+    Scheduler *sched = calloc(1, sizeof(Scheduler));
+    if (!sched) {
+        perror("malloc scheduler failed");
+        exit(1);
+    }
+    sched->node_count = process_count;
+    sched->worker_count = workers;
+    sched->remaining = process_count;
+    sched->entry = entry;
+    sched->arg = arg;
+    pthread_mutex_init(&sched->idle_lock, NULL);
+    pthread_cond_init(&sched->idle_cond, NULL);
+
+    MemTransport *mem = mem_transport_create(process_count);
+    mem_transport_set_scheduler(mem, sched);
+
+    for (int i = 0; i < workers; i++) {
+        Worker *worker = &sched->workers[i];
+        worker->index = i;
+        worker->sched = sched;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    // Стартовое распределение по кругу, дальше балансирует воровство
+    for (int i = 0; i < process_count; i++) {
+        Coroutine *co = &sched->nodes[i];
+        coroutine_init(co, init_ipc_threaded((local_id)i, process_count, mem));
+        queue_push(&sched->workers[i % workers].queue, co);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&sched->workers[i].thread, NULL, worker_main, &sched->workers[i]) != 0) {
+            perror("pthread_create failed");
+            exit(1);
+        }
+    }
+
+    int rc = 0;
+    for (int i = 0; i < workers; i++) {
+        pthread_join(sched->workers[i].thread, NULL);
+        pthread_mutex_destroy(&sched->workers[i].queue.lock);
+    }
+
+    for (int i = 0; i < process_count; i++) {
+        Coroutine *co = &sched->nodes[i];
+        if (co->rc != 0) {
+            rc = -1;
+        }
+        cleanup_ipc(co->ipc);
+        munmap(co->stack, co->stack_size);
+    }
+
+    mem_transport_destroy(mem);
+    pthread_mutex_destroy(&sched->idle_lock);
+    pthread_cond_destroy(&sched->idle_cond);
+    free(sched);
+    return rc;
+}
@@ -0,0 +1,27 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "thread_transport.h"
+
+// Асинхронный режим: каждый узел - сопрограмма со своим стеком, узлы
+// выполняются небольшим пулом потоков. receive()/receive_any() на пустом
+// канале не блокируют поток, а уступают его другой готовой сопрограмме;
+// запись в канал снова ставит получателя в очередь. У каждого потока своя
+// очередь готовых сопрограмм, простаивающий поток забирает работу у соседей.
+// Каналы - те же очереди в памяти, что и в ipc_run_threads().
+
+enum {
+    COROUTINE_STACK_SIZE = 256 * 1024   ///< Message на стеке - это уже 4 КБ
+};
+
+/** Запустить process_count узлов сопрограммами на workers потоках и дождаться их.
+ *
+ * entry - то же тело узла, что и для ipc_run_threads(); ipc_self() внутри
+ * возвращает контекст текущей сопрограммы, на каком бы потоке она ни шла.
+ * workers <= 0 - по числу процессоров.
+ *
+ * @return 0 если все узлы вернули 0, иначе -1
+ */
+int ipc_run_coroutines(int process_count, int workers, ThreadEntry entry, void * arg);
+
+#endif // COROUTINE_H
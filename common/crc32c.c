@@ -0,0 +1,120 @@
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HAVE_ARM 1
+#endif
+
+
+enum {
+    CRC32C_POLY = 0x82F63B78  // отраженный 0x1EDC6F41
+};
+
+typedef uint32_t (*Crc32cFn)(uint32_t crc, const unsigned char *p, size_t len);
+
+static uint32_t crc_table[8][256];
+static Crc32cFn crc_impl = NULL;
+
+static void table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xFF];
+        }
+    }
+}
+
+// Программный вариант: 8 независимых поисков в таблицах на 8 байт
+static uint32_t crc_sw(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc_hw(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+static int hw_supported(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ecx & bit_SSE4_2) != 0;
+}
+#elif defined(CRC32C_HAVE_ARM)
+static uint32_t crc_hw(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+static int hw_supported(void) {
+    return 1;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    Crc32cFn impl = __atomic_load_n(&crc_impl, __ATOMIC_ACQUIRE);
+    if (!impl) {
+        // Повторная инициализация из другого потока запишет те же значения
+        impl = crc_sw;
+#if defined(CRC32C_HAVE_SSE42) || defined(CRC32C_HAVE_ARM)
+        if (hw_supported()) {
+            impl = crc_hw;
+        }
+#endif
+        if (impl == crc_sw) {
+            table_init();
+        }
+        __atomic_store_n(&crc_impl, impl, __ATOMIC_RELEASE);
+    }
+
+    return ~impl(~crc, (const unsigned char *)data, len);
+}
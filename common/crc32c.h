@@ -0,0 +1,15 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (полином Кастаньоли). На x86_64 с SSE4.2 и на ARMv8 с расширением
+// CRC считается инструкцией процессора по 8 байт за такт, иначе - таблицами
+// slicing-by-8. Выбор делается один раз при первом вызове.
+
+/** Продолжить crc по data[0..len). Начальное значение - 0.
+ */
+uint32_t crc32c(uint32_t crc, const void * data, size_t len);
+
+#endif // CRC32C_H
@@ -0,0 +1,132 @@
+#include "failure_detector.h"
+#include "clock.h"
+#include "ipc_context.h"
+#include "ipc_frame.h"
+#include <signal.h>
+#include <string.h>
+
+
+static int64_t monotonic_ns(void) {
+    return (int64_t)clock_now_ns();
+}
+
+void failure_detector_init(IPC *ipc) {
+    FailureDetector *det = &ipc->detector;
+    int64_t now = monotonic_ns();
+
+    det->timeout_ns = 0;
+    det->heartbeat_ns = 0;
+    for (int i = 0; i <= MAX_PROCESS_ID; i++) {
+        det->last_heard[i] = now;
+        det->last_sent[i] = now;
+    }
+    memset(det->dead, 0, sizeof(det->dead));
+}
+
+void failure_detector_configure(void *self, int timeout_ms, int heartbeat_ms) {
+    IPC *ipc = (IPC *)self;
+    FailureDetector *det = &ipc->detector;
+    int64_t now = monotonic_ns();
+
+    det->timeout_ns = (int64_t)timeout_ms * 1000000;
+    det->heartbeat_ns = (int64_t)heartbeat_ms * 1000000;
+
+    // Отсчет молчания начинается с момента включения
+    for (int i = 0; i <= MAX_PROCESS_ID; i++) {
+        det->last_heard[i] = now;
+    }
+
+    if (timeout_ms > 0) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+}
+
+int failure_detector_enabled(IPC *ipc) {
+    return ipc->detector.timeout_ns > 0;
+}
+
+int failure_detector_poll_ms(IPC *ipc) {
+    // Без пульса просыпаться незачем: отказ виден только по EOF/EPIPE
+    if (!failure_detector_enabled(ipc) || ipc->detector.heartbeat_ns <= 0) {
+        return -1;
+    }
+    return (int)(ipc->detector.heartbeat_ns / 1000000);
+}
+
+void failure_detector_heard(IPC *ipc, local_id peer) {
+    ipc->detector.last_heard[peer] = monotonic_ns();
+}
+
+void failure_detector_sent(IPC *ipc, local_id peer) {
+    ipc->detector.last_sent[peer] = monotonic_ns();
+}
+
+void failure_detector_evict(IPC *ipc, local_id peer) {
+    if (!ipc->detector.dead[peer]) {
+        ipc->detector.dead[peer] = 1;
+        log_event(ipc->events_log, "Process %d: peer %d evicted", ipc->id, peer);
+    }
+}
+
+void failure_detector_tick(void *self) {
+    IPC *ipc = (IPC *)self;
+    FailureDetector *det = &ipc->detector;
+
+    if (!failure_detector_enabled(ipc) || det->heartbeat_ns <= 0) {
+        return;
+    }
+
+    Message msg;
+    msg.s_header.s_magic = MESSAGE_MAGIC;
+    msg.s_header.s_type = ACK;
+    msg.s_header.s_payload_len = 0;
+    msg.s_header.s_local_time = 0;
+
+    FrameExt ext;
+    ext.s_flags = FRAME_HEARTBEAT;
+    ext.s_origin = ipc->id;
+    ext.s_seq = 0;
+
+    Message frame;
+    wrap_frame(&msg, &ext, &frame);
+
+    int64_t now = monotonic_ns();
+    for (local_id i = 0; i < ipc->process_count; i++) {
+        if (i == ipc->id || det->dead[i] || !channel_writable(ipc, i)) {
+            continue;
+        }
+        // Недавняя обычная запись уже сообщила соседу, что мы живы
+        if (now - det->last_sent[i] >= det->heartbeat_ns) {
+            write_frame(ipc, i, &frame);
+        }
+    }
+    // Пульс не должен застрять в буфере склейки
+    ipc_flush(ipc);
+}
+
+int peer_alive(void *self, local_id peer) {
+    IPC *ipc = (IPC *)self;
+    FailureDetector *det = &ipc->detector;
+
+    if (peer < 0 || peer >= ipc->process_count) {
+        return 0;
+    }
+    if (peer == ipc->id) {
+        return 1;
+    }
+    if (det->dead[peer]) {
+        return 0;
+    }
+    // Канала от соседа нет в топологии - молчание ничего не значит
+    if (!topology_has_link(peer, ipc->id, ipc->process_count)) {
+        return 1;
+    }
+    // Без пульса молчащий сосед может быть просто занят
+    if (det->timeout_ns > 0 && det->heartbeat_ns > 0 &&
+        monotonic_ns() - det->last_heard[peer] > det->timeout_ns) {
+        failure_detector_evict(ipc, peer);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,38 @@
+#ifndef FAILURE_DETECTOR_H
+#define FAILURE_DETECTOR_H
+
+#include "ipc.h"
+
+// Детектор отказов соседей. Любой принятый кадр считается признаком жизни,
+// в простое соседям раз в heartbeat_ms уходит пустой кадр-пульс.
+// Сосед исключается, если канал от него закрыт (EOF/EPIPE) или он молчит
+// дольше timeout_ms. Пока детектор включен, ожидания в receive*() и
+// ipc_barrier() ограничены по времени и не зависают на мертвом соседе.
+
+enum {
+    FD_DEFAULT_TIMEOUT_MS = 3000,
+    FD_DEFAULT_HEARTBEAT_MS = 300
+};
+
+/** Включить детектор (timeout_ms > 0) или выключить (timeout_ms == 0).
+ *
+ * heartbeat_ms == 0 выключает пульс: тогда сосед исключается только по
+ * закрытому каналу, а ожидания в receive*() не ограничены по времени.
+ *
+ * Включение игнорирует SIGPIPE: запись в канал умершего соседа должна
+ * вернуть ошибку, а не завершить процесс.
+ */
+void failure_detector_configure(void * self, int timeout_ms, int heartbeat_ms);
+
+/** Отправить пульс соседям, которым ничего не писали дольше heartbeat_ms.
+ *
+ * receive*() вызывают это сами, пока ждут; вызывать вручную нужно только
+ * в длинных вычислениях без обмена сообщениями.
+ */
+void failure_detector_tick(void * self);
+
+/** @return 1 если сосед считается живым, 0 если исключен или молчит дольше таймаута
+ */
+int peer_alive(void * self, local_id peer);
+
+#endif // FAILURE_DETECTOR_H
@@ -1,5 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "common.h"
 #include "ipc.h"
+#include "failure_detector.h"
+#include "clock.h"
+#include "crc32c.h"
+#include "compress.h"
+#include "metrics.h"
+#include "wait_policy.h"
+#include "placement.h"
+#include "ipc_context.h"
+#include "ipc_frame.h"
+#include "replay.h"
+#include "trace.h"
 #include "pa1.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,20 +22,8 @@
 #include <time.h>
 #include <sys/wait.h>
 #include <stdarg.h>
-
-
-typedef struct {
-    int read_fd;
-    int write_fd;
-} Pipe;
-
-typedef struct {
-    local_id id;
-    int process_count;
-    Pipe **pipes;
-    FILE *events_log;
-    FILE *pipes_log;
-} IPC;
+#include <poll.h>
+#include <errno.h>
 
 
 
@@ -44,6 +45,13 @@ void log_pipes_info(IPC *ipc_context) {
         return;
     }
     
+    if (ipc_context->mem) {
+        fprintf(ipc_context->pipes_log, "=== Process %d: in-memory channels, %d peers ===\n\n",
+                ipc_context->id, ipc_context->process_count - 1);
+        fflush(ipc_context->pipes_log);
+        return;
+    }
+    
     fprintf(ipc_context->pipes_log, "=== Pipe descriptors for Process %d ===\n", ipc_context->id);
     
     for (int i = 0; i < ipc_context->process_count; i++) {
@@ -56,6 +64,11 @@ void log_pipes_info(IPC *ipc_context) {
                        pipe->read_fd, 
                        pipe->write_fd,
                        (pipe->read_fd == -1 || pipe->write_fd == -1) ? "(CLOSED)" : "(OPEN)");
+                if (ipc_context->lanes > 1) {
+                    fprintf(ipc_context->pipes_log,
+                           "Pipe[%d][%d] bulk: read_fd=%d, write_fd=%d\n",
+                           i, j, pipe->bulk_read_fd, pipe->bulk_write_fd);
+                }
             }
         }
     }
@@ -63,29 +76,56 @@ void log_pipes_info(IPC *ipc_context) {
     fflush(ipc_context->pipes_log);
 }
 
+// Каналы полосы IPC_LANE_BULK. Создаются вместе с основными до fork(),
+// поэтому дети наследуют их без изменения сигнатур create_all_pipes()/child_process()
+static int bulk_pipes[MAX_PROCESS_ID + 1][MAX_PROCESS_ID + 1][2];
+static int bulk_pipes_created = 0;
+
+static int lanes_from_env(void) {
+    const char *value = getenv("IPC_LANES");
+    return value && atoi(value) > 1 ? IPC_LANES : 1;
+}
+
+static void open_pipe(int fds[2]) {
+    if (pipe(fds) == -1) {
+        perror("pipe creation failed");
+        exit(1);
+    }
+    
+    // Устанавливаем блокирующий режим
+    int flags;
+    flags = fcntl(fds[0], F_GETFL, 0);
+    fcntl(fds[0], F_SETFL, flags & ~O_NONBLOCK);
+    flags = fcntl(fds[1], F_GETFL, 0);
+    fcntl(fds[1], F_SETFL, flags & ~O_NONBLOCK);
+}
+
 void create_all_pipes(int process_count, int pipes[][MAX_PROCESS_ID + 1][2]) {
+    int lanes = lanes_from_env();
+    
     for (int i = 0; i < process_count; i++) {
         for (int j = 0; j < process_count; j++) {
-            if (i != j) {
-                if (pipe(pipes[i][j]) == -1) {
-                    perror("pipe creation failed");
-                    exit(1);
+            pipes[i][j][0] = -1;
+            pipes[i][j][1] = -1;
+            bulk_pipes[i][j][0] = -1;
+            bulk_pipes[i][j][1] = -1;
+            // Пары без ребра в топологии остаются без канала
+            if (i != j && topology_has_link(i, j, process_count)) {
+                open_pipe(pipes[i][j]);
+                pipe_set_capacity(pipes[i][j][1], pipe_capacity_for(i, j, IPC_LANE_CONTROL));
+                if (lanes > 1) {
+                    open_pipe(bulk_pipes[i][j]);
+                    pipe_set_capacity(bulk_pipes[i][j][1], pipe_capacity_for(i, j, IPC_LANE_BULK));
                 }
-                
-                // Устанавливаем блокирующий режим
-                int flags;
-                flags = fcntl(pipes[i][j][0], F_GETFL, 0);
-                fcntl(pipes[i][j][0], F_SETFL, flags & ~O_NONBLOCK);
-                flags = fcntl(pipes[i][j][1], F_GETFL, 0);
-                fcntl(pipes[i][j][1], F_SETFL, flags & ~O_NONBLOCK);
             }
         }
     }
+    bulk_pipes_created = lanes > 1;
 }
 
 
-// Функция для инициализации IPC с уже созданными пайпами
-IPC* init_ipc_with_pipes(local_id id, int process_count, int pipes[][MAX_PROCESS_ID + 1][2]) {
+// Общая часть инициализации: все каналы пока закрыты
+static IPC* create_ipc(local_id id, int process_count, const char *log_mode) {
     IPC *ipc_context = malloc(sizeof(IPC));
     if (!ipc_context) {
         perror("malloc IPC failed");
@@ -94,6 +134,36 @@ IPC* init_ipc_with_pipes(local_id id, int process_count, int pipes[][MAX_PROCESS
     
     ipc_context->id = id;
     ipc_context->process_count = process_count;
+    ipc_context->multicast_mode = IPC_MULTICAST_FLAT;
+    ipc_context->multicast_seq = 0;
+    memset(ipc_context->multicast_seen, 0, sizeof(ipc_context->multicast_seen));
+    ipc_context->deferred_count = 0;
+    ipc_context->barrier_epoch = 0;
+    memset(ipc_context->barrier_pending, 0, sizeof(ipc_context->barrier_pending));
+    failure_detector_init(ipc_context);
+    memset(ipc_context->recv_seq, 0, sizeof(ipc_context->recv_seq));
+    ipc_context->outbuf = NULL;
+    ipc_context->coalesce_threshold = 0;
+    wait_policy_init(&ipc_context->wait, 0);
+    ipc_context->timestamps = 0;
+    ipc_context->last_latency_ns = -1;
+    ipc_context->mem = NULL;
+    ipc_context->checksums = 0;
+    ipc_context->compress_min = 0;
+    memset(ipc_context->traffic, 0, sizeof(ipc_context->traffic));
+    ipc_context->lanes = 1;
+    ipc_context->rr_cursor = 0;
+    for (int i = 0; i <= MAX_PROCESS_ID; i++) {
+        ipc_context->peer_weight[i] = 1;
+        ipc_context->deficit[i] = 0;
+    }
+    memset(ipc_context->lane_of_type, IPC_LANE_CONTROL, sizeof(ipc_context->lane_of_type));
+    ipc_context->lane_of_type[STARTED] = IPC_LANE_BULK;
+    ipc_context->lane_of_type[BALANCE_HISTORY] = IPC_LANE_BULK;
+    memset(ipc_context->send_chan_seq, 0, sizeof(ipc_context->send_chan_seq));
+    memset(ipc_context->recv_chan_seq, 0, sizeof(ipc_context->recv_chan_seq));
+    memset(ipc_context->chan_errors, 0, sizeof(ipc_context->chan_errors));
+    metrics_init_from_env(ipc_context);
     
     ipc_context->pipes = malloc(process_count * sizeof(Pipe*));
     if (!ipc_context->pipes) {
@@ -108,32 +178,171 @@ IPC* init_ipc_with_pipes(local_id id, int process_count, int pipes[][MAX_PROCESS
             exit(1);
         }
         for (int j = 0; j < process_count; j++) {
-            if (i != j) {
-                // Используем переданные пайпы
-                ipc_context->pipes[i][j].read_fd = pipes[i][j][0];
-                ipc_context->pipes[i][j].write_fd = pipes[i][j][1];
-            } else {
-                ipc_context->pipes[i][j].read_fd = -1;
-                ipc_context->pipes[i][j].write_fd = -1;
-            }
+            ipc_context->pipes[i][j].read_fd = -1;
+            ipc_context->pipes[i][j].write_fd = -1;
+            ipc_context->pipes[i][j].bulk_read_fd = -1;
+            ipc_context->pipes[i][j].bulk_write_fd = -1;
         }
     }
     
-    ipc_context->events_log = fopen("events.log", id == 0 ? "w" : "a");
+    ipc_context->events_log = fopen("events.log", log_mode);
     if (!ipc_context->events_log) {
         perror("fopen events.log failed");
         exit(1);
     }
     
-    ipc_context->pipes_log = fopen("pipes.log", id == 0 ? "w" : "a");
+    ipc_context->pipes_log = fopen("pipes.log", log_mode);
     if (!ipc_context->pipes_log) {
         perror("fopen pipes.log failed");
         exit(1);
     }
     
+    replay_init_from_env(ipc_context);
+    
     return ipc_context;
 }
 
+static void attach_pipes(IPC *ipc_context, int pipes[][MAX_PROCESS_ID + 1][2]) {
+    int process_count = ipc_context->process_count;
+    ipc_context->lanes = bulk_pipes_created ? IPC_LANES : 1;
+    
+    for (int i = 0; i < process_count; i++) {
+        for (int j = 0; j < process_count; j++) {
+            if (i != j) {
+                // Используем переданные пайпы
+                ipc_context->pipes[i][j].read_fd = pipes[i][j][0];
+                ipc_context->pipes[i][j].write_fd = pipes[i][j][1];
+                if (bulk_pipes_created) {
+                    ipc_context->pipes[i][j].bulk_read_fd = bulk_pipes[i][j][0];
+                    ipc_context->pipes[i][j].bulk_write_fd = bulk_pipes[i][j][1];
+                }
+            }
+        }
+    }
+}
+
+// Функция для инициализации IPC с уже созданными пайпами
+IPC* init_ipc_with_pipes(local_id id, int process_count, int pipes[][MAX_PROCESS_ID + 1][2]) {
+    IPC *ipc_context = create_ipc(id, process_count, id == 0 ? "w" : "a");
+    attach_pipes(ipc_context, pipes);
+    return ipc_context;
+}
+
+void *ipc_fork_nodes(int process_count, local_id *id) {
+    static int pipes[MAX_PROCESS_ID + 1][MAX_PROCESS_ID + 1][2];
+    
+    if (process_count <= 0 || process_count > MAX_PROCESS_ID + 1) {
+        return NULL;
+    }
+    // Журналы очищаются до fork(): иначе родитель мог бы стереть записи детей
+    if (prepare_shared_logs() != 0) {
+        return NULL;
+    }
+    create_all_pipes(process_count, pipes);
+    
+    local_id self_id = PARENT_ID;
+    for (local_id i = 1; i < process_count; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork failed");
+            exit(1);
+        }
+        if (pid == 0) {
+            self_id = i;
+            break;
+        }
+    }
+    
+    // Привязка к CPU до выделения буферов IPC - они окажутся на своем NUMA-узле
+    placement_apply_from_env(self_id, process_count);
+    
+    IPC *ipc_context = create_ipc(self_id, process_count, "a");
+    attach_pipes(ipc_context, pipes);
+    close_unused_pipes(ipc_context);
+    
+    *id = self_id;
+    return ipc_context;
+}
+
+void ipc_close(void *self) {
+    cleanup_ipc((IPC *)self);
+}
+
+// Узел-поток: каналы - очереди mem, журналы заранее очищены в ipc_run_threads()
+IPC* init_ipc_threaded(local_id id, int process_count, MemTransport *mem) {
+    IPC *ipc_context = create_ipc(id, process_count, "a");
+    ipc_context->mem = mem;
+    ipc_context->lanes = lanes_from_env();
+    return ipc_context;
+}
+
+int channel_writable(IPC *ipc, local_id dst) {
+    if (ipc->mem) {
+        return topology_has_link(ipc->id, dst, ipc->process_count);
+    }
+    return ipc->pipes[ipc->id][dst].write_fd >= 0;
+}
+
+static int channel_readable(IPC *ipc, local_id from) {
+    if (ipc->mem) {
+        return topology_has_link(from, ipc->id, ipc->process_count);
+    }
+    return ipc->pipes[from][ipc->id].read_fd >= 0;
+}
+
+static int lane_read_fd(IPC *ipc, local_id from, int lane) {
+    Pipe *pipe = &ipc->pipes[from][ipc->id];
+    return lane == IPC_LANE_BULK ? pipe->bulk_read_fd : pipe->read_fd;
+}
+
+static int lane_write_fd(IPC *ipc, local_id dst, int lane) {
+    Pipe *pipe = &ipc->pipes[ipc->id][dst];
+    return lane == IPC_LANE_BULK ? pipe->bulk_write_fd : pipe->write_fd;
+}
+
+static ssize_t channel_read(IPC *ipc, local_id from, int lane, void *buf, size_t len) {
+    if (ipc->mem) {
+        return mem_channel_read(ipc->mem, lane, from, ipc->id, buf, len);
+    }
+    return read(lane_read_fd(ipc, from, lane), buf, len);
+}
+
+void ipc_set_lane(void *self, MessageType type, int lane) {
+    IPC *ipc = (IPC *)self;
+    if ((int)type >= 0 && (int)type < IPC_LANE_TYPES && lane >= 0 && lane < IPC_LANES) {
+        ipc->lane_of_type[type] = (uint8_t)lane;
+    }
+}
+
+// Полоса для кадра. Служебные кадры и рассылки деревом сохраняют порядок
+// (эпохи барьера, номера рассылок) только внутри одной полосы
+static int frame_lane(IPC *ipc, const Message *msg) {
+    if (ipc->lanes == 1) {
+        return IPC_LANE_CONTROL;
+    }
+    
+    if (msg->s_header.s_magic == MESSAGE_MAGIC_EXT) {
+        uint8_t flags;
+        memcpy(&flags, msg->s_payload, sizeof(flags));
+        if (flags & (FRAME_TREE | FRAME_BARRIER | FRAME_HEARTBEAT)) {
+            return IPC_LANE_CONTROL;
+        }
+    }
+    
+    int16_t type = msg->s_header.s_type;
+    if (type < 0 || type >= IPC_LANE_TYPES) {
+        return IPC_LANE_CONTROL;
+    }
+    return ipc->lane_of_type[type];
+}
+
+
+static void close_fd(int *fd) {
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
 
 void close_unused_pipes(IPC *ipc_context) {
     if (!ipc_context) return;
@@ -142,15 +351,16 @@ void close_unused_pipes(IPC *ipc_context) {
         for (int j = 0; j < ipc_context->process_count; j++) {
             if (i != j) {
                 // Закрываем каналы записи, которые не принадлежат текущему процессу
-                if (i != ipc_context->id && ipc_context->pipes[i][j].write_fd != -1) {
-                    close(ipc_context->pipes[i][j].write_fd);
-                    ipc_context->pipes[i][j].write_fd = -1;
+                Pipe *pipe = &ipc_context->pipes[i][j];
+                if (i != ipc_context->id) {
+                    close_fd(&pipe->write_fd);
+                    close_fd(&pipe->bulk_write_fd);
                 }
                 
                 // Закрываем каналы чтения, которые не предназначены текущему процессу
-                if (j != ipc_context->id && ipc_context->pipes[i][j].read_fd != -1) {
-                    close(ipc_context->pipes[i][j].read_fd);
-                    ipc_context->pipes[i][j].read_fd = -1;
+                if (j != ipc_context->id) {
+                    close_fd(&pipe->read_fd);
+                    close_fd(&pipe->bulk_read_fd);
                 }
             }
         }
@@ -159,14 +369,15 @@ void close_unused_pipes(IPC *ipc_context) {
 
 void cleanup_ipc(IPC *ipc_context) {
     if (ipc_context) {
+        ipc_set_coalescing(ipc_context, 0);
+        
         for (int i = 0; i < ipc_context->process_count; i++) {
             for (int j = 0; j < ipc_context->process_count; j++) {
-                if (ipc_context->pipes[i][j].read_fd != -1) {
-                    close(ipc_context->pipes[i][j].read_fd);
-                }
-                if (ipc_context->pipes[i][j].write_fd != -1) {
-                    close(ipc_context->pipes[i][j].write_fd);
-                }
+                Pipe *pipe = &ipc_context->pipes[i][j];
+                close_fd(&pipe->read_fd);
+                close_fd(&pipe->write_fd);
+                close_fd(&pipe->bulk_read_fd);
+                close_fd(&pipe->bulk_write_fd);
             }
         }
         
@@ -178,40 +389,400 @@ void cleanup_ipc(IPC *ipc_context) {
         if (ipc_context->events_log) fclose(ipc_context->events_log);
         if (ipc_context->pipes_log) fclose(ipc_context->pipes_log);
         
+        replay_close(ipc_context);
+        metrics_detach(ipc_context);
         free(ipc_context);
     }
 }
 
 
 
-int send(void *self, local_id dst, const Message *msg) {
+void ipc_set_multicast_mode(void *self, IpcMulticastMode mode) {
+    IPC *ipc = (IPC *)self;
+    ipc->multicast_mode = mode;
+}
+
+void ipc_set_timestamps(void *self, int enabled) {
+    IPC *ipc = (IPC *)self;
+    ipc->timestamps = enabled;
+}
+
+int64_t ipc_last_latency_ns(void *self) {
+    IPC *ipc = (IPC *)self;
+    return ipc->last_latency_ns;
+}
+
+void ipc_set_compression(void *self, size_t min_len) {
+    IPC *ipc = (IPC *)self;
+    ipc->compress_min = min_len;
+}
+
+uint8_t frame_default_flags(IPC *ipc) {
+    return ipc->timestamps ? FRAME_TIMESTAMP : 0;
+}
+
+// Запись уже готового кадра (обычного или расширенного) в канал к dst
+static int write_bytes(IPC *ipc, local_id dst, int lane, const void *data, size_t len) {
+    if (ipc->mem) {
+        if (mem_channel_write(ipc->mem, lane, ipc->id, dst, data, len) != 0) {
+            return -1;
+        }
+        failure_detector_sent(ipc, dst);
+        return 0;
+    }
+    
+    ssize_t bytes_written = write(lane_write_fd(ipc, dst, lane), data, len);
+    
+    if (bytes_written != (ssize_t)len) {
+        // Читающий конец закрыт - соседа больше нет
+        if (bytes_written < 0 && errno == EPIPE) {
+            failure_detector_evict(ipc, dst);
+        }
+        return -1;
+    }
+    
+    failure_detector_sent(ipc, dst);
+    return 0;
+}
+
+static int flush_peer(IPC *ipc, local_id dst) {
+    OutBuffer *out = &ipc->outbuf[dst];
+    if (out->len == 0) {
+        return 0;
+    }
+    
+    int rc = write_bytes(ipc, dst, IPC_LANE_CONTROL, out->data, out->len);
+    out->len = 0;
+    return rc;
+}
+
+int ipc_flush(void *self) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->outbuf) {
+        return 0;
+    }
+    
+    int rc = 0;
+    for (local_id i = 0; i < ipc->process_count; i++) {
+        if (flush_peer(ipc, i) != 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+void ipc_set_coalescing(void *self, size_t threshold) {
+    IPC *ipc = (IPC *)self;
+    
+    ipc_flush(ipc);
+    if (threshold == 0) {
+        free(ipc->outbuf);
+        ipc->outbuf = NULL;
+        ipc->coalesce_threshold = 0;
+        return;
+    }
+    
+    if (!ipc->outbuf) {
+        ipc->outbuf = calloc(ipc->process_count, sizeof(OutBuffer));
+        if (!ipc->outbuf) {
+            perror("malloc coalescing buffers failed");
+            exit(1);
+        }
+    }
+    ipc->coalesce_threshold = threshold < IPC_COALESCE_MAX ? threshold : IPC_COALESCE_MAX;
+}
+
+void ipc_set_checksums(void *self, int enabled) {
+    IPC *ipc = (IPC *)self;
+    ipc->checksums = enabled;
+}
+
+int ipc_channel_errors(void *self, local_id peer, IpcChannelErrors *errors) {
     IPC *ipc = (IPC *)self;
+    if (peer < 0 || peer >= ipc->process_count) {
+        return -1;
+    }
+    *errors = ipc->chan_errors[peer];
+    return 0;
+}
+
+static uint32_t frame_crc(const Message *frame) {
+    return crc32c(0, frame, sizeof(MessageHeader) + frame->s_header.s_payload_len);
+}
+
+// Копия кадра с FrameCheck для канала к dst. Обычное сообщение становится
+// расширенным кадром, в расширенный поле вставляется (или, при пересылке
+// по дереву, перезаписывается)
+static int seal_frame(IPC *ipc, local_id dst, int lane, const Message *msg, Message *sealed) {
+    uint8_t flags = 0;
+    if (msg->s_header.s_magic == MESSAGE_MAGIC_EXT) {
+        memcpy(&flags, msg->s_payload, sizeof(flags));
+    }
+    
+    if (msg->s_header.s_magic != MESSAGE_MAGIC_EXT) {
+        FrameExt ext;
+        ext.s_flags = FRAME_CHECKSUM;
+        ext.s_origin = ipc->id;
+        ext.s_seq = 0;
+        if (wrap_frame(msg, &ext, sealed) != 0) {
+            return -1;
+        }
+        flags = FRAME_CHECKSUM;
+    } else if (!(flags & FRAME_CHECKSUM)) {
+        size_t offset = frame_check_offset(flags);
+        size_t rest = msg->s_header.s_payload_len - offset;
+        if (msg->s_header.s_payload_len + sizeof(FrameCheck) > MAX_PAYLOAD_LEN) {
+            return -1;
+        }
+        
+        sealed->s_header = msg->s_header;
+        sealed->s_header.s_payload_len += sizeof(FrameCheck);
+        memcpy(sealed->s_payload, msg->s_payload, offset);
+        memcpy(sealed->s_payload + offset + sizeof(FrameCheck), msg->s_payload + offset, rest);
+        flags |= FRAME_CHECKSUM;
+        memcpy(sealed->s_payload, &flags, sizeof(flags));
+    } else {
+        memcpy(sealed, msg, sizeof(MessageHeader) + msg->s_header.s_payload_len);
+    }
+    
+    FrameCheck check;
+    check.s_chan_seq = ++ipc->send_chan_seq[dst][lane];
+    check.s_crc = 0;
+    char *field = sealed->s_payload + frame_check_offset(flags);
+    memcpy(field, &check, sizeof(check));
+    
+    check.s_crc = frame_crc(sealed);
+    memcpy(field, &check, sizeof(check));
+    return 0;
+}
+
+// Проверка FrameCheck принятого кадра: CRC и пропуски номеров в канале.
+// 0 - кадр цел, -1 - испорчен
+static int verify_frame(IPC *ipc, local_id from, int lane, Message *frame) {
+    uint8_t flags;
+    if (frame->s_header.s_payload_len < sizeof(FrameExt)) {
+        return -1;
+    }
+    memcpy(&flags, frame->s_payload, sizeof(flags));
+    if (!(flags & FRAME_CHECKSUM)) {
+        return 0;
+    }
+    
+    size_t offset = frame_check_offset(flags);
+    if (frame->s_header.s_payload_len < offset + sizeof(FrameCheck)) {
+        return -1;
+    }
+    
+    FrameCheck check;
+    char *field = frame->s_payload + offset;
+    memcpy(&check, field, sizeof(check));
+    uint32_t crc = check.s_crc;
+    check.s_crc = 0;
+    memcpy(field, &check, sizeof(check));
+    
+    IpcChannelErrors *errors = &ipc->chan_errors[from];
+    if (frame_crc(frame) != crc) {
+        errors->corrupt++;
+        log_event(ipc->events_log, "Process %d: corrupt frame from %d dropped", ipc->id, from);
+        return -1;
+    }
     
+    uint16_t expected = ipc->recv_chan_seq[from][lane] + 1;
+    if (check.s_chan_seq != expected) {
+        uint16_t gap = check.s_chan_seq - expected;
+        errors->lost += gap;
+        log_event(ipc->events_log, "Process %d: %u frames from %d lost (seq %u, expected %u)",
+                  ipc->id, gap, from, check.s_chan_seq, expected);
+    }
+    ipc->recv_chan_seq[from][lane] = check.s_chan_seq;
+    return 0;
+}
+
+int write_frame(IPC *ipc, local_id dst, const Message *msg) {
     if (dst < 0 || dst >= ipc->process_count || dst == ipc->id) {
         return -1;
     }
     
-    int write_fd = ipc->pipes[ipc->id][dst].write_fd;
-    if (write_fd < 0) {
+    if (!channel_writable(ipc, dst)) {
         return -1;
     }
     
+    // Пересылаемый по дереву кадр уже несет FrameCheck прошлого перехода - его надо обновить
+    uint8_t flags = 0;
+    if (msg->s_header.s_magic == MESSAGE_MAGIC_EXT && msg->s_header.s_payload_len > 0) {
+        memcpy(&flags, msg->s_payload, sizeof(flags));
+    }
+    
+    // Запечатанный кадр идет той же полосой, что и исходный
+    int lane = frame_lane(ipc, msg);
+    Message sealed;
+    if (ipc->checksums || (flags & FRAME_CHECKSUM)) {
+        if (seal_frame(ipc, dst, lane, msg, &sealed) != 0) {
+            return -1;
+        }
+        msg = &sealed;
+    }
+    
+    if (ipc->metrics) {
+        metrics_sent(ipc->metrics, dst, msg);
+    }
+    
     size_t total_len = sizeof(MessageHeader) + msg->s_header.s_payload_len;
-    ssize_t bytes_written = write(write_fd, msg, total_len);
+    ipc->traffic[dst].sent_msgs++;
+    ipc->traffic[dst].sent_bytes += total_len;
+    
+    // Склеивается только управляющая полоса; крупные кадры полосы данных склеивать незачем
+    if (!ipc->outbuf || lane != IPC_LANE_CONTROL) {
+        return write_bytes(ipc, dst, lane, msg, total_len);
+    }
+    
+    // Большой кадр идет отдельной записью, но после уже накопленных - порядок в канале сохраняется
+    OutBuffer *out = &ipc->outbuf[dst];
+    if (total_len >= ipc->coalesce_threshold) {
+        if (flush_peer(ipc, dst) != 0) {
+            return -1;
+        }
+        return write_bytes(ipc, dst, lane, msg, total_len);
+    }
     
-    if (bytes_written != (ssize_t)total_len) {
+    if (out->len + total_len > ipc->coalesce_threshold && flush_peer(ipc, dst) != 0) {
         return -1;
     }
+    memcpy(out->data + out->len, msg, total_len);
+    out->len += total_len;
     
+    if (out->len >= ipc->coalesce_threshold) {
+        return flush_peer(ipc, dst);
+    }
     return 0;
 }
 
-int send_multicast(void *self, const Message *msg) {
-    IPC *ipc = (IPC *)self;
+// Копия msg со сжатым payload, если сжатие включено и выигрывает хоть байт.
+// 0 - packed заполнен, -1 - слать msg как есть
+static int compress_message(IPC *ipc, const Message *msg, Message *packed) {
+    uint16_t len = msg->s_header.s_payload_len;
+    if (ipc->compress_min == 0 || len < ipc->compress_min) {
+        return -1;
+    }
+    
+    // Сжатое должно поместиться в кадр вместе с полями FrameExt
+    size_t cap = len < MAX_EXT_PAYLOAD_LEN ? len : MAX_EXT_PAYLOAD_LEN;
+    size_t packed_len = lz_compress(msg->s_payload, len, packed->s_payload, cap);
+    if (packed_len == 0) {
+        return -1;
+    }
+    
+    packed->s_header = msg->s_header;
+    packed->s_header.s_payload_len = (uint16_t)packed_len;
+    return 0;
+}
+
+static int send_message(IPC *ipc, local_id dst, const Message *msg) {
+    uint8_t flags = frame_default_flags(ipc);
+    
+    Message packed;
+    if (compress_message(ipc, msg, &packed) == 0) {
+        msg = &packed;
+        flags |= FRAME_COMPRESSED;
+    }
+    if (!flags) {
+        return write_frame(ipc, dst, msg);
+    }
+    
+    FrameExt ext;
+    ext.s_flags = flags;
+    ext.s_origin = ipc->id;
+    ext.s_seq = 0;
+    
+    Message frame;
+    if (wrap_frame(msg, &ext, &frame) != 0) {
+        return -1;
+    }
+    return write_frame(ipc, dst, &frame);
+}
+
+// Пересылка кадра детям текущего процесса в биномиальном дереве с корнем origin.
+// Ранг считается относительно корня, дети ранга r - это r + 2^k для 2^k > r.
+static int forward_tree(IPC *ipc, local_id origin, const Message *frame) {
+    int n = ipc->process_count;
+    int rel = (ipc->id - origin + n) % n;
+    
+    int mask = 1;
+    while (mask < n) {
+        mask <<= 1;
+    }
+    
+    // Сначала самые большие поддеревья: им дольше всего пересылать дальше
+    for (mask >>= 1; mask > rel; mask >>= 1) {
+        int child = rel + mask;
+        if (child < n && write_frame(ipc, (origin + child) % n, frame) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int wrap_frame(const Message *msg, const FrameExt *ext, Message *frame) {
+    size_t ext_len = frame_ext_len(ext->s_flags);
+    if (ext_len + msg->s_header.s_payload_len > MAX_PAYLOAD_LEN) {
+        return -1;
+    }
+    
+    frame->s_header = msg->s_header;
+    frame->s_header.s_magic = MESSAGE_MAGIC_EXT;
+    frame->s_header.s_payload_len = ext_len + msg->s_header.s_payload_len;
+    
+    char *pos = frame->s_payload;
+    memcpy(pos, ext, sizeof(FrameExt));
+    pos += sizeof(FrameExt);
+    
+    if (ext->s_flags & FRAME_TIMESTAMP) {
+        uint64_t now = clock_now_ns();
+        memcpy(pos, &now, sizeof(now));
+        pos += sizeof(now);
+    }
+    
+    // Номер и CRC заполнит seal_frame() при записи в канал
+    if (ext->s_flags & FRAME_CHECKSUM) {
+        memset(pos, 0, sizeof(FrameCheck));
+        pos += sizeof(FrameCheck);
+    }
+    
+    memcpy(pos, msg->s_payload, msg->s_header.s_payload_len);
+    
+    return 0;
+}
+
+static int send_multicast_tree(IPC *ipc, const Message *msg) {
+    FrameExt ext;
+    ext.s_flags = FRAME_TREE | frame_default_flags(ipc);
+    ext.s_origin = ipc->id;
+    ext.s_seq = ++ipc->multicast_seq;
+    
+    Message packed;
+    if (compress_message(ipc, msg, &packed) == 0) {
+        msg = &packed;
+        ext.s_flags |= FRAME_COMPRESSED;
+    }
+    
+    Message frame;
+    if (wrap_frame(msg, &ext, &frame) != 0) {
+        return -1;
+    }
+    
+    return forward_tree(ipc, ipc->id, &frame);
+}
+
+static int multicast_message(IPC *ipc, const Message *msg) {
+    // Дерево пересылает через любые пары - без полной сетки рассылаем напрямую
+    if (ipc->multicast_mode == IPC_MULTICAST_TREE && topology_is_mesh()) {
+        return send_multicast_tree(ipc, msg);
+    }
     
     for (local_id i = 0; i < ipc->process_count; i++) {
-        if (i != ipc->id) {
-            if (send(self, i, msg) != 0) {
+        if (i != ipc->id && topology_has_link(ipc->id, i, ipc->process_count)) {
+            if (send_message(ipc, i, msg) != 0) {
                 return -1;
             }
         }
@@ -220,44 +791,439 @@ int send_multicast(void *self, const Message *msg) {
     return 0;
 }
 
-int receive(void *self, local_id from, Message *msg) {
+// Разбор расширенного кадра: пересылка дальше по дереву и снятие FrameExt,
+// чтобы вызывающий получил обычное сообщение
+static int unwrap_frame(IPC *ipc, Message *msg, FrameExt *ext) {
+    if (msg->s_header.s_payload_len < sizeof(FrameExt)) {
+        return -1;
+    }
+    
+    memcpy(ext, msg->s_payload, sizeof(FrameExt));
+    
+    size_t ext_len = frame_ext_len(ext->s_flags);
+    if (msg->s_header.s_payload_len < ext_len) {
+        return -1;
+    }
+    
+    if (ext->s_flags & FRAME_HEARTBEAT) {
+        return 1;
+    }
+    
+    if (ext->s_flags & FRAME_TREE) {
+        if (ext->s_origin < 0 || ext->s_origin >= ipc->process_count || ext->s_origin == ipc->id) {
+            return -1;
+        }
+        
+        // Дубликат или устаревшая рассылка - отбрасываем
+        if ((int16_t)(ext->s_seq - ipc->multicast_seen[ext->s_origin]) <= 0) {
+            return 1;
+        }
+        ipc->multicast_seen[ext->s_origin] = ext->s_seq;
+        
+        if (forward_tree(ipc, ext->s_origin, msg) != 0) {
+            log_event(ipc->events_log, "Process %d failed to forward multicast from %d",
+                      ipc->id, ext->s_origin);
+        }
+    }
+    
+    if (ext->s_flags & FRAME_TIMESTAMP) {
+        uint64_t sent_ns;
+        memcpy(&sent_ns, msg->s_payload + sizeof(FrameExt), sizeof(sent_ns));
+        ipc->last_latency_ns = (int64_t)(clock_now_ns() - sent_ns);
+    }
+    
+    msg->s_header.s_magic = MESSAGE_MAGIC;
+    msg->s_header.s_payload_len -= ext_len;
+    
+    // Распаковка сразу на место payload, без промежуточного memmove
+    if (ext->s_flags & FRAME_COMPRESSED) {
+        char packed[MAX_PAYLOAD_LEN];
+        memcpy(packed, msg->s_payload + ext_len, msg->s_header.s_payload_len);
+        ssize_t len = lz_decompress(packed, msg->s_header.s_payload_len, msg->s_payload, MAX_PAYLOAD_LEN);
+        if (len < 0) {
+            log_event(ipc->events_log, "Process %d: malformed compressed frame from %d",
+                      ipc->id, ext->s_origin);
+            return -1;
+        }
+        msg->s_header.s_payload_len = (uint16_t)len;
+        return 0;
+    }
+    
+    memmove(msg->s_payload, msg->s_payload + ext_len, msg->s_header.s_payload_len);
+    return 0;
+}
+
+// Набор входящих каналов для WaitPolicy: pipe опрашиваются poll(),
+// очереди в памяти - проверкой на пустоту, блокировка на futex-звонке
+typedef struct {
+    IPC *ipc;
+    struct pollfd fds[(MAX_PROCESS_ID + 1) * IPC_LANES];
+    local_id peers[(MAX_PROCESS_ID + 1) * IPC_LANES];
+    int lanes[(MAX_PROCESS_ID + 1) * IPC_LANES];
+    int count;
+} ChannelSet;
+
+static void channel_set_add(ChannelSet *set, local_id from, int lane) {
+    IPC *ipc = set->ipc;
+    if (!ipc->mem) {
+        set->fds[set->count].fd = lane_read_fd(ipc, from, lane);
+        set->fds[set->count].events = POLLIN;
+        set->fds[set->count].revents = 0;
+    }
+    set->peers[set->count] = from;
+    set->lanes[set->count] = lane;
+    set->count++;
+}
+
+// Есть ли что читать в k-м канале после ожидания
+static int channel_set_has_data(ChannelSet *set, int k) {
+    IPC *ipc = set->ipc;
+    if (ipc->mem) {
+        return mem_channel_ready(ipc->mem, set->lanes[k], set->peers[k], ipc->id);
+    }
+    return (set->fds[k].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+}
+
+static int channel_set_ready(void *arg) {
+    ChannelSet *set = (ChannelSet *)arg;
+    if (!set->ipc->mem) {
+        return poll(set->fds, set->count, 0) > 0;
+    }
+    
+    for (int k = 0; k < set->count; k++) {
+        if (channel_set_has_data(set, k)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int channel_set_block(void *arg, int timeout_ms) {
+    ChannelSet *set = (ChannelSet *)arg;
+    IPC *ipc = set->ipc;
+    if (ipc->mem) {
+        return mem_transport_wait(ipc->mem, ipc->id, channel_set_ready, set, timeout_ms);
+    }
+    return poll(set->fds, set->count, timeout_ms);
+}
+
+void ipc_set_wait_policy(void *self, uint32_t spin_limit) {
     IPC *ipc = (IPC *)self;
+    wait_policy_init(&ipc->wait, spin_limit);
+}
+
+// Ожидание данных от from с рассылкой пульса, пока ждем.
+// Для pipe без детектора и опроса сразу возвращает 0 - дальше обычное блокирующее чтение
+static int wait_readable(IPC *ipc, local_id from) {
+    int timeout = failure_detector_poll_ms(ipc);
+    if (!ipc->mem && ipc->lanes == 1 && timeout < 0 && ipc->wait.spin_limit == 0) {
+        return 0;
+    }
+    
+    ChannelSet set;
+    set.ipc = ipc;
+    set.count = 0;
+    for (int lane = 0; lane < ipc->lanes; lane++) {
+        channel_set_add(&set, from, lane);
+    }
+    
+    while (1) {
+        int rc = wait_policy_wait(&ipc->wait, channel_set_ready, channel_set_block, &set, timeout);
+        if (rc > 0) {
+            return 0;
+        }
+        if (rc < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (rc < 0) {
+            continue;
+        }
+        
+        failure_detector_tick(ipc);
+        if (!peer_alive(ipc, from)) {
+            return -1;
+        }
+    }
+}
+
+static int header_valid(const MessageHeader *header) {
+    return (header->s_magic == MESSAGE_MAGIC || header->s_magic == MESSAGE_MAGIC_EXT) &&
+           header->s_payload_len <= MAX_PAYLOAD_LEN;
+}
+
+// Полоса, из которой читать следующий кадр от from: управляющая, если в ней что-то есть.
+// Вызывается после wait_readable(), так что хотя бы одна полоса готова
+static int ready_lane(IPC *ipc, local_id from) {
+    if (ipc->lanes == 1) {
+        return IPC_LANE_CONTROL;
+    }
+    
+    if (ipc->mem) {
+        return mem_channel_ready(ipc->mem, IPC_LANE_CONTROL, from, ipc->id) ? IPC_LANE_CONTROL : IPC_LANE_BULK;
+    }
+    
+    struct pollfd fds[IPC_LANES];
+    for (int lane = 0; lane < IPC_LANES; lane++) {
+        fds[lane].fd = lane_read_fd(ipc, from, lane);
+        fds[lane].events = POLLIN;
+        fds[lane].revents = 0;
+    }
+    poll(fds, IPC_LANES, 0);
+    
+    for (int lane = 0; lane < IPC_LANES; lane++) {
+        if (fds[lane].revents & POLLIN) {
+            return lane;
+        }
+    }
+    // Данных нет ни в одной полосе - читаем управляющую, она сообщит о закрытии
+    return IPC_LANE_CONTROL;
+}
+
+// Поток рассинхронизирован: сдвигаем окно заголовка по байту до следующей
+// корректной магии. Побайтное чтение - только на этом редком пути
+static int resync_header(IPC *ipc, local_id from, int lane, MessageHeader *header) {
+    unsigned char *window = (unsigned char *)header;
+    uint32_t skipped = 0;
+    
+    while (!header_valid(header)) {
+        memmove(window, window + 1, sizeof(MessageHeader) - 1);
+        if (channel_read(ipc, from, lane, window + sizeof(MessageHeader) - 1, 1) != 1) {
+            ipc->chan_errors[from].resync_bytes += skipped + 1;
+            return -1;
+        }
+        skipped++;
+    }
+    
+    ipc->chan_errors[from].resync_bytes += skipped;
+    log_event(ipc->events_log, "Process %d: stream from %d resynchronized after %u bytes",
+              ipc->id, from, skipped);
+    return 0;
+}
+
+int receive_frame(IPC *ipc, local_id from, Message *msg, FrameExt *ext) {
+    memset(ext, 0, sizeof(FrameExt));
+    ipc->last_latency_ns = -1;
+    
+    // Перед возможной блокировкой отдаем накопленное - иначе сосед может ждать нашего ответа
+    ipc_flush(ipc);
     
     if (from < 0 || from >= ipc->process_count || from == ipc->id) {
         return -1;
     }
     
-    int read_fd = ipc->pipes[from][ipc->id].read_fd;
-    if (read_fd < 0) {
+    if (!channel_readable(ipc, from)) {
+        return -1;
+    }
+    
+    if (wait_readable(ipc, from) != 0) {
         return -1;
     }
     
-    ssize_t bytes_read = read(read_fd, &msg->s_header, sizeof(MessageHeader));
+    int lane = ready_lane(ipc, from);
+    ssize_t bytes_read = channel_read(ipc, from, lane, &msg->s_header, sizeof(MessageHeader));
     if (bytes_read != sizeof(MessageHeader)) {
+        // EOF: все концы записи закрыты, сосед завершился
+        if (bytes_read == 0) {
+            failure_detector_evict(ipc, from);
+        }
         return -1;
     }
     
-    if (msg->s_header.s_magic != MESSAGE_MAGIC) {
+    if (!header_valid(&msg->s_header) && resync_header(ipc, from, lane, &msg->s_header) != 0) {
         return -1;
     }
     
     if (msg->s_header.s_payload_len > 0) {
-        bytes_read = read(read_fd, msg->s_payload, msg->s_header.s_payload_len);
+        bytes_read = channel_read(ipc, from, lane, msg->s_payload, msg->s_header.s_payload_len);
         if (bytes_read != msg->s_header.s_payload_len) {
+            if (bytes_read == 0) {
+                failure_detector_evict(ipc, from);
+            }
             return -1;
         }
     }
     
+    failure_detector_heard(ipc, from);
+    wait_policy_arrived(&ipc->wait);
+    ipc->traffic[from].received_msgs++;
+    ipc->traffic[from].received_bytes += sizeof(MessageHeader) + msg->s_header.s_payload_len;
+    if (ipc->metrics) {
+        metrics_received(ipc->metrics, from, msg);
+    }
+    
+    if (msg->s_header.s_magic == MESSAGE_MAGIC_EXT) {
+        // Испорченный кадр отброшен, поток дальше цел - для вызывающего это поглощенный кадр
+        if (verify_frame(ipc, from, lane, msg) != 0) {
+            return 1;
+        }
+        return unwrap_frame(ipc, msg, ext);
+    }
+    
     return 0;
 }
 
-int receive_any(void *self, Message *msg) {
+int defer_message(IPC *ipc, local_id from, const Message *msg) {
+    if (ipc->deferred_count == IPC_DEFERRED_MAX) {
+        log_event(ipc->events_log, "Process %d: deferred queue overflow, message from %d lost",
+                  ipc->id, from);
+        return -1;
+    }
+    
+    DeferredMessage *slot = &ipc->deferred[ipc->deferred_count++];
+    slot->from = from;
+    size_t len = sizeof(MessageHeader) + msg->s_header.s_payload_len;
+    memcpy(&slot->msg, msg, len);
+    
+    return 0;
+}
+
+// Достать отложенное сообщение от *from (или от кого угодно, если *from < 0)
+static int take_deferred(IPC *ipc, local_id *from, Message *msg) {
+    for (int k = 0; k < ipc->deferred_count; k++) {
+        if (*from < 0 || ipc->deferred[k].from == *from) {
+            *from = ipc->deferred[k].from;
+            const Message *stored = &ipc->deferred[k].msg;
+            memcpy(msg, stored, sizeof(MessageHeader) + stored->s_header.s_payload_len);
+            
+            ipc->deferred_count--;
+            memmove(&ipc->deferred[k], &ipc->deferred[k + 1],
+                    (ipc->deferred_count - k) * sizeof(DeferredMessage));
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
+static int receive_message(IPC *ipc, local_id from, Message *msg) {
+    if (take_deferred(ipc, &from, msg) == 0) {
+        ipc->recv_seq[from]++;
+        return 0;
+    }
+    
+    FrameExt ext;
+    if (receive_frame(ipc, from, msg, &ext) != 0) {
+        return -1;
+    }
+    
+    // Сообщение барьера от более быстрого соседа - запоминаем для ipc_barrier()
+    if (ext.s_flags & FRAME_BARRIER) {
+        ipc->barrier_pending[from]++;
+        return -1;
+    }
+    
+    ipc->recv_seq[from]++;
+    return 0;
+}
+
+void ipc_set_peer_weight(void *self, local_id peer, uint16_t weight) {
     IPC *ipc = (IPC *)self;
+    if (peer >= 0 && peer < ipc->process_count) {
+        ipc->peer_weight[peer] = weight > 0 ? weight : 1;
+    }
+}
+
+// Дефицитный круговой обход готовых соседей: за раунд сосед i получает
+// peer_weight[i] сообщений. Обход продолжается с того, на ком остановились,
+// так что младшие id (и родитель) не обслуживаются всегда первыми
+static local_id drr_next(IPC *ipc, const uint8_t *ready) {
+    int n = ipc->process_count;
+    
+    for (int round = 0; round < 2; round++) {
+        for (int k = 0; k < n; k++) {
+            local_id i = (ipc->rr_cursor + k) % n;
+            if (ready[i] && ipc->deficit[i] > 0) {
+                ipc->deficit[i]--;
+                ipc->rr_cursor = ipc->deficit[i] > 0 ? i : (i + 1) % n;
+                return i;
+            }
+        }
+        
+        // У всех готовых права кончились - новый раунд. Простаивающий сосед
+        // не копит права впрок
+        for (local_id i = 0; i < n; i++) {
+            ipc->deficit[i] = ready[i] ? ipc->deficit[i] + ipc->peer_weight[i] : 0;
+        }
+    }
+    
+    return -1;
+}
+
+enum {
+    RECEIVE_EMPTY = 1  ///< receive_next(): за время ожидания ни один канал не стал готов
+};
+
+// Следующее сообщение от любого соседа. block == 0 - не ждать, если ничего не готово
+static int receive_next(IPC *ipc, Message *msg, local_id *from, int block) {
+    // Воспроизведение: ждем именно того соседа, что был записан
+    if (replay_next_peer(ipc, from) == 0) {
+        if (receive_message(ipc, *from, msg) != 0) {
+            return -1;
+        }
+        replay_advance(ipc, *from);
+        return 0;
+    }
+    
+    *from = -1;
+    if (take_deferred(ipc, from, msg) == 0) {
+        ipc->recv_seq[*from]++;
+        replay_record(ipc, *from);
+        return 0;
+    }
+    
+    ChannelSet set;
+    set.ipc = ipc;
+    set.count = 0;
+    
+    for (int lane = 0; lane < ipc->lanes; lane++) {
+        for (local_id i = 0; i < ipc->process_count; i++) {
+            if (i != ipc->id && channel_readable(ipc, i) && !ipc->detector.dead[i]) {
+                channel_set_add(&set, i, lane);
+            }
+        }
+    }
+    
+    if (set.count == 0) {
+        return -1;
+    }
     
-    for (local_id i = 0; i < ipc->process_count; i++) { 
-        if (i != ipc->id) {
-            log_event(ipc->events_log, read_log, ipc->id ,i);
-            if (receive(self, i, msg) == 0) {
+    // Ждем готовности любого канала: последовательное блокирующее чтение
+    // зависало на молчащем соседе (при рассылке деревом это обычная ситуация).
+    // С детектором отказов ожидание ограничено периодом пульса
+    int ready;
+    if (block) {
+        ready = wait_policy_wait(&ipc->wait, channel_set_ready, channel_set_block, &set,
+                                 failure_detector_poll_ms(ipc));
+        if (ready == 0) {
+            failure_detector_tick(ipc);
+        }
+    } else {
+        ready = channel_set_ready(&set);
+    }
+    if (ready == 0) {
+        return RECEIVE_EMPTY;
+    }
+    if (ready < 0) {
+        return -1;
+    }
+    
+    // Сначала управляющая полоса: соседи с данными в ней, потом остальные
+    for (int lane = 0; lane < ipc->lanes; lane++) {
+        uint8_t ready_peers[MAX_PROCESS_ID + 1] = { 0 };
+        for (int k = 0; k < set.count; k++) {
+            if (set.lanes[k] == lane && channel_set_has_data(&set, k)) {
+                ready_peers[set.peers[k]] = 1;
+            }
+        }
+        
+        // Кадр мог оказаться служебным (пульс, дубликат) - пробуем следующего
+        local_id peer;
+        while ((peer = drr_next(ipc, ready_peers)) >= 0) {
+            ready_peers[peer] = 0;
+            log_event(ipc->events_log, read_log, ipc->id, peer);
+            if (receive_message(ipc, peer, msg) == 0) {
+                replay_record(ipc, peer);
+                *from = peer;
                 return 0;
             }
         }
@@ -266,15 +1232,119 @@ int receive_any(void *self, Message *msg) {
     return -1;
 }
 
+static int receive_any_message(IPC *ipc, Message *msg) {
+    ipc_flush(ipc);
+    
+    local_id from;
+    return receive_next(ipc, msg, &from, 1);
+}
 
-void child_process(local_id id, int process_count, int pipes[][MAX_PROCESS_ID + 1][2]) {
-    // Создаем IPC для дочернего процесса с уже созданными пайпами
-    IPC *ipc = init_ipc_with_pipes(id, process_count, pipes);
-    if (!ipc) {
-        exit(EXIT_FAILURE);
+static int receive_many_messages(IPC *ipc, Message *msgs, local_id *from, int max) {
+    ipc_flush(ipc);
+    
+    if (max <= 0) {
+        return -1;
     }
     
-    close_unused_pipes(ipc);
+    // 0 - пустой опрос, receive_many() вернет -1
+    local_id peer;
+    int rc = receive_next(ipc, &msgs[0], &peer, 1);
+    if (rc != 0) {
+        return rc == RECEIVE_EMPTY ? 0 : -1;
+    }
+    if (from) {
+        from[0] = peer;
+    }
+    
+    // Остальные - только уже пришедшие; при воспроизведении по одному, как записано
+    int count = 1;
+    while (count < max && ipc->replay.mode != REPLAY_REPLAY &&
+           receive_next(ipc, &msgs[count], &peer, 0) == 0) {
+        if (from) {
+            from[count] = peer;
+        }
+        count++;
+    }
+    
+    return count;
+}
+
+// Публичные функции ipc.h: замер длительности вызова для metrics.c
+int send(void *self, local_id dst, const Message *msg) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->metrics) {
+        return send_message(ipc, dst, msg);
+    }
+    
+    uint64_t start = clock_now_ns();
+    int rc = send_message(ipc, dst, msg);
+    metrics_call(ipc->metrics, METRIC_OP_SEND, rc, clock_now_ns() - start);
+    return rc;
+}
+
+int send_multicast(void *self, const Message *msg) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->metrics) {
+        return multicast_message(ipc, msg);
+    }
+    
+    uint64_t start = clock_now_ns();
+    int rc = multicast_message(ipc, msg);
+    metrics_call(ipc->metrics, METRIC_OP_MULTICAST, rc, clock_now_ns() - start);
+    return rc;
+}
+
+int receive(void *self, local_id from, Message *msg) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->metrics) {
+        return receive_message(ipc, from, msg);
+    }
+    
+    uint64_t start = clock_now_ns();
+    int rc = receive_message(ipc, from, msg);
+    metrics_call(ipc->metrics, METRIC_OP_RECEIVE, rc, clock_now_ns() - start);
+    return rc;
+}
+
+int receive_many(void *self, Message *msgs, local_id *from, int max) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->metrics) {
+        int count = receive_many_messages(ipc, msgs, from, max);
+        return count > 0 ? count : -1;
+    }
+    
+    uint64_t start = clock_now_ns();
+    int count = receive_many_messages(ipc, msgs, from, max);
+    int rc = count > 0 ? 0 : (count == 0 ? RECEIVE_EMPTY : -1);
+    metrics_call(ipc->metrics, METRIC_OP_RECEIVE_ANY, rc, clock_now_ns() - start);
+    return count > 0 ? count : -1;
+}
+
+int receive_any(void *self, Message *msg) {
+    IPC *ipc = (IPC *)self;
+    if (!ipc->metrics) {
+        return receive_any_message(ipc, msg) == 0 ? 0 : -1;
+    }
+    
+    uint64_t start = clock_now_ns();
+    int rc = receive_any_message(ipc, msg);
+    metrics_call(ipc->metrics, METRIC_OP_RECEIVE_ANY, rc, clock_now_ns() - start);
+    return rc == 0 ? 0 : -1;
+}
+
+
+// Протокол PA1 для одного узла; общий для процессов и потоков
+static int run_pa1_node(IPC *ipc) {
+    local_id id = ipc->id;
+    
+    // STARTED и DONE ждут от всех: без полной сетки протокол не выполнить
+    if (!ipc_topology_complete(ipc->process_count)) {
+        fprintf(stderr, "process %d: PA1 needs channels between all processes, check IPC_TOPOLOGY\n", id);
+        return -1;
+    }
+    
+    // Барьеры ниже не должны зависать, если кто-то из процессов умер
+    failure_detector_configure(ipc, FD_DEFAULT_TIMEOUT_MS, FD_DEFAULT_HEARTBEAT_MS);
     
     // Фаза 1: Синхронизация запуска
     char started_msg[100];
@@ -282,23 +1352,12 @@ void child_process(local_id id, int process_count, int pipes[][MAX_PROCESS_ID +
     
     log_event(ipc->events_log, log_started_fmt, id, getpid(), getppid());
     
-    Message msg;
-    msg.s_header.s_magic = MESSAGE_MAGIC;
-    msg.s_header.s_type = STARTED;
-    msg.s_header.s_payload_len = strlen(started_msg);
-    memcpy(msg.s_payload, started_msg, msg.s_header.s_payload_len);
-    
-    if (send_multicast(ipc, &msg) != 0) {
-        cleanup_ipc(ipc);
-        exit(EXIT_FAILURE);
-    }
-    
-    // Ждем STARTED от всех других процессов
-    int received_started = 0;
-    while (received_started < process_count - 1) {
-        if (receive_any(ipc, &msg) == 0 && msg.s_header.s_type == STARTED) {
-            received_started++;
-        }
+    // Барьер вместо рассылки STARTED всем и ожидания N-1 ответов
+    trace_begin("STARTED barrier");
+    int rc = ipc_barrier(ipc, STARTED, started_msg, strlen(started_msg));
+    trace_end("STARTED barrier");
+    if (rc != 0) {
+        return -1;
     }
     
     log_event(ipc->events_log, log_received_all_started_fmt, id);
@@ -310,26 +1369,46 @@ void child_process(local_id id, int process_count, int pipes[][MAX_PROCESS_ID +
     char done_msg[100];
     snprintf(done_msg, sizeof(done_msg), log_done_fmt, id);
     
-    msg.s_header.s_magic = MESSAGE_MAGIC;
-    msg.s_header.s_type = DONE;
-    msg.s_header.s_payload_len = strlen(done_msg);
-    memcpy(msg.s_payload, done_msg, msg.s_header.s_payload_len);
+    trace_begin("DONE barrier");
+    rc = ipc_barrier(ipc, DONE, done_msg, strlen(done_msg));
+    trace_end("DONE barrier");
+    if (rc != 0) {
+        return -1;
+    }
+    
+    log_event(ipc->events_log, log_received_all_done_fmt, id);
+    return 0;
+}
+
+void child_process(local_id id, int process_count, int pipes[][MAX_PROCESS_ID + 1][2]) {
+    // Привязка к CPU до выделения буферов IPC - они окажутся на своем NUMA-узле
+    placement_apply_from_env(id, process_count);
+    trace_init(id);
     
-    if (send_multicast(ipc, &msg) != 0) {
-        cleanup_ipc(ipc);
+    // Создаем IPC для дочернего процесса с уже созданными пайпами
+    trace_begin("ipc setup");
+    IPC *ipc = init_ipc_with_pipes(id, process_count, pipes);
+    if (!ipc) {
         exit(EXIT_FAILURE);
     }
     
-    // Ждем DONE от всех других процессов
-    int received_done = 0;
-    while (received_done < process_count - 1) {
-        if (receive_any(ipc, &msg) == 0 && msg.s_header.s_type == DONE) {
-            received_done++;
-        }
-    }
+    close_unused_pipes(ipc);
+    trace_end("ipc setup");
     
-    log_event(ipc->events_log, log_received_all_done_fmt, id);
+    int rc = run_pa1_node(ipc);
     
     cleanup_ipc(ipc);
-    exit(EXIT_SUCCESS);
+    trace_flush();
+    exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int child_thread(void *self, local_id id, void *arg) {
+    (void)arg;
+    // Буфер трассировки привязан к потоку, а сопрограммы переходят между потоками
+    if (!coroutine_current()) {
+        trace_init(id);
+    }
+    int rc = run_pa1_node((IPC *)self);
+    trace_flush();
+    return rc;
 }
@@ -0,0 +1,195 @@
+#ifndef IPC_CONTEXT_H
+#define IPC_CONTEXT_H
+
+#include "ipc.h"
+#include "ipc_ext.h"
+#include "ipc_frame.h"
+#include "metrics.h"
+#include "wait_policy.h"
+#include <stdio.h>
+#include <sys/types.h>
+
+enum {
+    IPC_DEFERRED_MAX = 8
+};
+
+typedef struct {
+    size_t len;
+    char data[IPC_COALESCE_MAX];
+} OutBuffer;
+
+typedef struct {
+    int read_fd;
+    int write_fd;
+    int bulk_read_fd;     // полоса IPC_LANE_BULK, -1 если полоса одна
+    int bulk_write_fd;
+} Pipe;
+
+typedef struct {
+    local_id from;
+    Message msg;
+} DeferredMessage;
+
+typedef struct {
+    uint64_t sent_msgs;
+    uint64_t sent_bytes;
+    uint64_t received_msgs;
+    uint64_t received_bytes;
+} ChannelTraffic;
+
+typedef struct {
+    int64_t timeout_ns;                    // 0 - детектор выключен
+    int64_t heartbeat_ns;
+    int64_t last_heard[MAX_PROCESS_ID + 1];
+    int64_t last_sent[MAX_PROCESS_ID + 1];
+    uint8_t dead[MAX_PROCESS_ID + 1];
+} FailureDetector;
+
+typedef struct {
+    int mode;           // ReplayMode
+    FILE *file;         // запись
+    uint8_t *log;       // воспроизведение: журнал целиком в памяти
+    size_t log_len;
+    size_t cursor;
+} ReplayState;
+
+// Каналы в памяти для узлов-потоков (thread_transport.c)
+typedef struct MemTransport MemTransport;
+typedef struct Scheduler Scheduler;
+typedef struct Coroutine Coroutine;
+
+typedef struct {
+    local_id id;
+    int process_count;
+    Pipe **pipes;
+    MemTransport *mem;    // не NULL - узел-поток, pipes не используются
+    FILE *events_log;
+    FILE *pipes_log;
+
+    // Рассылка send_multicast()
+    IpcMulticastMode multicast_mode;
+    uint16_t multicast_seq;                      // номер последней своей рассылки
+    uint16_t multicast_seen[MAX_PROCESS_ID + 1]; // последний принятый номер от каждого отправителя
+
+    // Сообщения приложения, прочитанные внутри ipc_barrier(); receive*() отдает их первыми
+    DeferredMessage deferred[IPC_DEFERRED_MAX];
+    int deferred_count;
+
+    // Барьер: номер текущей эпохи и число пришедших, но еще не учтенных сообщений от соседа
+    uint16_t barrier_epoch;
+    uint8_t barrier_pending[MAX_PROCESS_ID + 1];
+
+    FailureDetector detector;
+
+    // Число доставленных приложению сообщений по каждому входящему каналу
+    uint16_t recv_seq[MAX_PROCESS_ID + 1];
+    ReplayState replay;
+
+    // Метки clock_now_ns() в кадрах
+    int timestamps;
+    int64_t last_latency_ns;  // задержка последнего принятого кадра, -1 если без метки
+
+    // Слот счетчиков в разделяемой памяти, NULL если метрики выключены
+    ProcessMetrics *metrics;
+    MetricsPage *metrics_page;
+
+    // Склейка мелких кадров: буфер на каждого соседа, NULL если выключена
+    OutBuffer *outbuf;
+    size_t coalesce_threshold;
+
+    // Опрос перед блокировкой в receive*()
+    WaitPolicy wait;
+
+    // Полосы приоритета: 1 - все в одном канале
+    int lanes;
+    uint8_t lane_of_type[IPC_LANE_TYPES];
+
+    // Справедливый receive_any(): курсор обхода, веса и накопленные права соседей
+    local_id rr_cursor;
+    uint16_t peer_weight[MAX_PROCESS_ID + 1];
+    uint32_t deficit[MAX_PROCESS_ID + 1];
+
+    // Контроль целостности: номера кадров по каналам и полосам, счетчики ошибок.
+    // Полосы читаются не по порядку отправки, поэтому нумерация у каждой своя
+    int checksums;
+    uint16_t send_chan_seq[MAX_PROCESS_ID + 1][IPC_LANES];
+    uint16_t recv_chan_seq[MAX_PROCESS_ID + 1][IPC_LANES];
+    IpcChannelErrors chan_errors[MAX_PROCESS_ID + 1];
+
+    // Сжатие payload от compress_min байт, 0 - выключено
+    size_t compress_min;
+
+    // Кадры и байты по каналам для ipc_channel_info()
+    ChannelTraffic traffic[MAX_PROCESS_ID + 1];
+} IPC;
+
+void log_event(FILE *events_log, const char *format, ...);
+void log_pipes_info(IPC *ipc_context);
+void create_all_pipes(int process_count, int pipes[][MAX_PROCESS_ID + 1][2]);
+IPC* init_ipc_with_pipes(local_id id, int process_count, int pipes[][MAX_PROCESS_ID + 1][2]);
+void close_unused_pipes(IPC *ipc_context);
+void cleanup_ipc(IPC *ipc_context);
+IPC* init_ipc_threaded(local_id id, int process_count, MemTransport *mem);
+int channel_writable(IPC *ipc, local_id dst);
+
+// Низкоуровневые операции с кадрами для модулей поверх ipc.c
+int write_frame(IPC *ipc, local_id dst, const Message *msg);
+int wrap_frame(const Message *msg, const FrameExt *ext, Message *frame);
+// 0 - сообщение получено, 1 - кадр поглощен (дубликат), -1 - ошибка
+int receive_frame(IPC *ipc, local_id from, Message *msg, FrameExt *ext);
+int defer_message(IPC *ipc, local_id from, const Message *msg);
+// Флаги, которые добавляются к каждому исходящему кадру (например FRAME_TIMESTAMP)
+uint8_t frame_default_flags(IPC *ipc);
+
+// Обратные вызовы детектора отказов из ipc.c
+void failure_detector_init(IPC *ipc);
+int failure_detector_enabled(IPC *ipc);
+int failure_detector_poll_ms(IPC *ipc);  // -1 если выключен или без пульса - ждать без ограничения
+void failure_detector_heard(IPC *ipc, local_id peer);
+void failure_detector_sent(IPC *ipc, local_id peer);
+void failure_detector_evict(IPC *ipc, local_id peer);
+
+// Запись/воспроизведение порядка receive_any()
+void replay_init_from_env(IPC *ipc);
+void replay_record(IPC *ipc, local_id from);
+int replay_next_peer(IPC *ipc, local_id *from);  // -1 если не воспроизводим
+void replay_advance(IPC *ipc, local_id from);
+
+// Емкость pipe по политике (pipe_policy.c)
+int pipe_capacity_for(local_id from, local_id to, int lane);
+// Установить емкость (bytes > 0) и вернуть фактическую, -1 при ошибке
+int pipe_set_capacity(int fd, int bytes);
+
+// Топология каналов (topology.c)
+int topology_has_link(local_id from, local_id to, int process_count);
+int topology_is_mesh(void);
+
+// Очереди thread_transport.c: [from][to] пишут много потоков, читает один
+MemTransport *mem_transport_create(int process_count);
+void mem_transport_destroy(MemTransport *mem);
+int mem_channel_write(MemTransport *mem, int lane, local_id from, local_id to, const void *data, size_t len);
+ssize_t mem_channel_read(MemTransport *mem, int lane, local_id from, local_id to, void *buf, size_t len);
+int mem_channel_ready(MemTransport *mem, int lane, local_id from, local_id to);
+// Ждать, пока ready(arg) не станет истинным или не выйдет timeout_ms; 1 - готово, 0 - таймаут.
+// Внутри сопрограммы не блокирует поток, а паркует сопрограмму
+int mem_transport_wait(MemTransport *mem, local_id to, WaitReadyFn ready, void *arg, int timeout_ms);
+void mem_transport_set_scheduler(MemTransport *mem, Scheduler *sched);
+// Очистить events.log/pipes.log перед запуском узлов в одном процессе
+int prepare_shared_logs(void);
+
+// Планировщик сопрограмм (coroutine.c)
+Coroutine *coroutine_current(void);
+IPC *coroutine_ipc(Coroutine *co);
+// Уступить поток до scheduler_wake() или до deadline_ns по clock_now_ns() (-1 - без ограничения)
+void coroutine_park(Coroutine *co, int64_t deadline_ns);
+void scheduler_wake(Scheduler *sched, local_id id);
+
+// Счетчики metrics.c; вызываются только при ipc->metrics != NULL
+void metrics_init_from_env(IPC *ipc);
+void metrics_detach(IPC *ipc);
+// rc: 0 - успех, > 0 - пустой опрос receive_any(), < 0 - ошибка
+void metrics_call(ProcessMetrics *m, MetricOp op, int rc, uint64_t elapsed_ns);
+void metrics_sent(ProcessMetrics *m, local_id peer, const Message *msg);
+void metrics_received(ProcessMetrics *m, local_id peer, const Message *msg);
+
+#endif // IPC_CONTEXT_H
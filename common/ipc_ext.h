@@ -0,0 +1,264 @@
+#ifndef IPC_EXT_H
+#define IPC_EXT_H
+
+#include "ipc.h"
+
+// Расширения API из ipc.h (сам ipc.h менять нельзя).
+// Как и в ipc.h, self - структура, переданная в send()/receive().
+
+typedef enum {
+    IPC_MULTICAST_FLAT = 0,  ///< отправитель сам пишет N-1 копий
+    IPC_MULTICAST_TREE       ///< биномиальное дерево, O(log N) шагов
+} IpcMulticastMode;
+
+/** Создать каналы между process_count процессами и запустить узлы
+ * 1..process_count-1 через fork(); вызывающий становится узлом PARENT_ID.
+ *
+ * Каналы создает create_all_pipes(), чужие концы каждый процесс закрывает сам.
+ * Сразу после fork() каждый узел привязывается к CPU по IPC_PLACEMENT,
+ * до выделения своего контекста.
+ *
+ * @param id  Сюда пишется local_id узла, в котором вернулась функция
+ *
+ * @return контекст этого узла для send()/receive() и функций ниже;
+ *         NULL если process_count вне диапазона или журналы не открываются
+ */
+void * ipc_fork_nodes(int process_count, local_id * id);
+
+/** Закрыть каналы узла и освободить контекст из ipc_fork_nodes().
+ */
+void ipc_close(void * self);
+
+/** Выбрать способ рассылки для send_multicast().
+ *
+ * Принимать TREE-рассылки умеет любой процесс независимо от своего режима.
+ */
+void ipc_set_multicast_mode(void * self, IpcMulticastMode mode);
+
+/** Ставить ли в каждое исходящее сообщение метку clock_now_ns().
+ *
+ * Метка едет в расширенном заголовке и снимается в receive(), приложение
+ * видит обычное сообщение. Получатель узнает задержку через ipc_last_latency_ns().
+ */
+void ipc_set_timestamps(void * self, int enabled);
+
+/** @return задержка доставки последнего принятого сообщения в наносекундах
+ *          или -1, если отправитель не ставил метку
+ */
+int64_t ipc_last_latency_ns(void * self);
+
+enum {
+    IPC_COALESCE_MAX = 4096  ///< PIPE_BUF в Linux: запись до этого размера в канал атомарна
+};
+
+/** Включить склейку мелких кадров (threshold > 0) или выключить (0).
+ *
+ * Кадры короче threshold копятся в буфере соседа и уходят одной записью,
+ * когда буфер наберет threshold байт, при ipc_flush() или перед ожиданием
+ * в receive*()/ipc_barrier(). Формат потока в канале не меняется.
+ * Перед завершением процесса без cleanup_ipc() нужно вызвать ipc_flush().
+ */
+void ipc_set_coalescing(void * self, size_t threshold);
+
+/** Отправить все накопленные кадры.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int ipc_flush(void * self);
+
+/** Политика ожидания в receive*() и ipc_barrier().
+ *
+ * spin_limit > 0: перед блокировкой до spin_limit итераций опроса каналов
+ * с pause, фактическая длина подбирается по интервалам между сообщениями
+ * (см. wait_policy.h). 0 - сразу блокироваться (по умолчанию).
+ */
+void ipc_set_wait_policy(void * self, uint32_t spin_limit);
+
+enum {
+    IPC_LANE_CONTROL = 0,  ///< короткие управляющие сообщения, читаются первыми
+    IPC_LANE_BULK,         ///< крупные данные: строки STARTED, BALANCE_HISTORY
+    IPC_LANES,
+    IPC_LANE_TYPES = 16    ///< полоса настраивается для s_type < IPC_LANE_TYPES
+};
+
+/** Направить сообщения типа type в полосу lane.
+ *
+ * Полосы - отдельные каналы между каждой парой процессов, включаются
+ * переменной окружения IPC_LANES=2 до create_all_pipes() (в режиме потоков -
+ * до ipc_run_threads()). receive()/receive_any() сначала читают управляющую
+ * полосу, поэтому STOP/ACK/DONE не стоят в очереди за историей балансов.
+ * Порядок сохраняется только внутри полосы. Кадры барьера, пульса и
+ * рассылки деревом всегда идут управляющей полосой.
+ * По умолчанию в IPC_LANE_BULK идут STARTED и BALANCE_HISTORY.
+ */
+void ipc_set_lane(void * self, MessageType type, int lane);
+
+enum {
+    IPC_PIPE_TO_PARENT_DEFAULT = 256 * 1024,
+    IPC_PIPE_BULK_DEFAULT = 128 * 1024
+};
+
+/// Емкость pipe по роли канала в байтах; 0 - размер ядра по умолчанию (64 КБ)
+typedef struct {
+    int to_parent;  ///< каналы к родителю: при STOP в них разом пишут все дети
+    int peer;       ///< остальные каналы управляющей полосы
+    int bulk;       ///< каналы полосы IPC_LANE_BULK
+} IpcPipePolicy;
+
+/** Задать емкость каналов, которые создаст create_all_pipes().
+ *
+ * Без вызова политика берется из переменной окружения
+ * IPC_PIPE_SIZE=to_parent,peer,bulk (числа с суффиксами K/M, пустое поле -
+ * значение по умолчанию). Ядро округляет размер до степени двойки страниц
+ * и не дает превысить /proc/sys/fs/pipe-max-size - тогда размер не меняется.
+ */
+void ipc_set_pipe_policy(const IpcPipePolicy * policy);
+
+/** Изменить емкость канала к dst в полосе lane во время работы.
+ *
+ * @return установленная емкость в байтах или -1, если канал не pipe
+ */
+int ipc_set_channel_capacity(void * self, local_id dst, int lane, int bytes);
+
+typedef enum {
+    IPC_TOPOLOGY_MESH = 0,  ///< каналы между всеми парами (по умолчанию)
+    IPC_TOPOLOGY_STAR,      ///< только родитель <-> каждый ребенок
+    IPC_TOPOLOGY_RING,      ///< i <-> (i + 1) mod N
+    IPC_TOPOLOGY_CUSTOM     ///< каналы из links
+} IpcTopologyKind;
+
+typedef struct {
+    IpcTopologyKind kind;
+    uint16_t links[MAX_PROCESS_ID + 1];  ///< CUSTOM: бит j в links[i] - канал i -> j
+} IpcTopology;
+
+/** Разобрать "mesh", "star", "ring" или "custom:0-1,1>2"
+ * ("a-b" - канал в обе стороны, "a>b" - только от a к b).
+ *
+ * @return 0 on success, -1 если строка некорректна
+ */
+int ipc_topology_parse(const char * spec, IpcTopology * topology);
+
+/** Прочитать топологию из файла: первое слово - вид, для custom дальше
+ * ребра в том же формате по одному или несколько в строке, '#' - комментарий.
+ *
+ * @return 0 on success, -1 если файла нет или он некорректен
+ */
+int ipc_topology_load(const char * path, IpcTopology * topology);
+
+/** Какие каналы создаст create_all_pipes() (и разрешит узлам-потокам).
+ * Вызывается до запуска узлов.
+ *
+ * Без вызова берется из переменной окружения IPC_TOPOLOGY (строка для
+ * ipc_topology_parse() или @путь к файлу). Отправка туда, где канала нет,
+ * возвращает ошибку; send_multicast() рассылает только соседям и вне полной
+ * сетки всегда напрямую, без дерева. ipc_barrier() и протоколы, где каждый
+ * ждет сообщения от всех (как STARTED/DONE в PA1), требуют полной сетки.
+ */
+void ipc_set_topology(const IpcTopology * topology);
+
+/** Есть ли в текущей топологии каналы между всеми парами из process_count
+ * процессов. Звезда из двух процессов или кольцо из трех - тоже полная сетка.
+ */
+int ipc_topology_complete(int process_count);
+
+typedef enum {
+    IPC_BACKEND_NONE = 0,  ///< канала нет в топологии
+    IPC_BACKEND_PIPE,
+    IPC_BACKEND_MEMORY     ///< очередь в памяти между потоками
+} IpcBackend;
+
+typedef struct {
+    IpcBackend backend;
+    int lanes;
+    int writable;             ///< есть канал к соседу
+    int readable;             ///< есть канал от соседа
+    int capacity;             ///< емкость канала к соседу в байтах, -1 - не ограничена
+    int out_queued;           ///< байт в канале к соседу, еще не прочитанных им; -1 - неизвестно
+    int in_queued;            ///< байт в канале от соседа, еще не прочитанных нами; -1 - неизвестно
+    uint64_t sent_msgs;       ///< кадров отправлено соседу, включая служебные
+    uint64_t sent_bytes;
+    uint64_t received_msgs;
+    uint64_t received_bytes;
+} IpcChannelInfo;
+
+/** Состояние каналов с peer: транспорт, заполненность и трафик с начала работы.
+ *
+ * @return 0 on success, -1 если peer вне диапазона
+ */
+int ipc_channel_info(void * self, local_id peer, IpcChannelInfo * info);
+
+/** Вес соседа в receive_any()/receive_many() (по умолчанию 1).
+ *
+ * Готовые каналы обслуживаются дефицитным круговым обходом: за раунд сосед
+ * отдает до weight сообщений, обход продолжается с места остановки, поэтому
+ * ни младшие id, ни родитель не обслуживаются всегда первыми. Управляющая
+ * полоса (см. ipc_set_lane()) по-прежнему читается раньше полосы данных.
+ */
+void ipc_set_peer_weight(void * self, local_id peer, uint16_t weight);
+
+/** Принять от 1 до max сообщений за вызов.
+ *
+ * Ждет первое сообщение, как receive_any(), затем без ожидания забирает
+ * уже пришедшие в порядке того же обхода.
+ *
+ * @param msgs  Массив из max сообщений
+ * @param from  Массив из max отправителей (может быть NULL)
+ *
+ * @return число принятых сообщений или -1, если не принято ни одного
+ */
+int receive_many(void * self, Message * msgs, local_id * from, int max);
+
+/** Защищать ли исходящие кадры номером в канале и CRC32C.
+ *
+ * Проверяет получатель независимо от своей настройки: испорченный кадр
+ * отбрасывается (receive() возвращает -1), пропуск номеров считается
+ * потерей, мусор в потоке пропускается до следующей корректной магии.
+ * Кадры, которые после добавления полей не помещаются в MAX_PAYLOAD_LEN,
+ * не отправляются.
+ */
+void ipc_set_checksums(void * self, int enabled);
+
+typedef struct {
+    uint32_t corrupt;       ///< кадров с неверной CRC
+    uint32_t lost;          ///< пропущено номеров в канале
+    uint32_t resync_bytes;  ///< байт мусора перед найденным заголовком
+} IpcChannelErrors;
+
+/** Счетчики ошибок канала от peer к этому процессу.
+ *
+ * @return 0 on success, -1 если peer вне диапазона
+ */
+int ipc_channel_errors(void * self, local_id peer, IpcChannelErrors * errors);
+
+enum {
+    IPC_COMPRESS_DEFAULT_MIN = 128  ///< порог, с которого сжатие обычно окупается
+};
+
+/** Сжимать payload от min_len байт (0 - не сжимать, по умолчанию).
+ *
+ * Сжатый кадр помечается флагом в расширенном заголовке и уходит, только если
+ * стал короче; receive() распаковывает его сам при любой своей настройке.
+ * Истории балансов и строки сжимаются в разы: повторы и серии одинаковых
+ * байт кодируются ссылками назад.
+ */
+void ipc_set_compression(void * self, size_t min_len);
+
+/** Барьер для всех process_count процессов (включая родителя).
+ *
+ * Диссеминационная схема: ceil(log2 N) раундов, в раунде k процесс отправляет
+ * сообщение типа type процессу (id + 2^k) mod N и ждет сообщение от
+ * (id - 2^k) mod N. Всего N * ceil(log2 N) сообщений вместо N * (N - 1).
+ * Сообщения приложения, пришедшие во время ожидания, не теряются -
+ * их вернет следующий receive()/receive_any(). Ретрансляции нет: без
+ * каналов между всеми парами (ipc_topology_complete()) барьер сразу
+ * возвращает ошибку, а не зависает.
+ *
+ * @param payload     Строка, передаваемая в каждом сообщении барьера (может быть NULL)
+ * @param payload_len Ее длина без '\0'
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int ipc_barrier(void * self, MessageType type, const char * payload, uint16_t payload_len);
+
+#endif // IPC_EXT_H
@@ -0,0 +1,58 @@
+#ifndef IPC_FRAME_H
+#define IPC_FRAME_H
+
+#include "ipc.h"
+
+// Расширенный кадр: заголовок MessageHeader с магией MESSAGE_MAGIC_EXT,
+// в начале payload лежит FrameExt, s_payload_len учитывает его размер.
+// Поэтому receive() читает такой кадр так же, как обычный.
+enum {
+    MESSAGE_MAGIC_EXT = 0xAFAE
+};
+
+// Флаги FrameExt.s_flags
+enum {
+    FRAME_TREE    = 0x01,  ///< рассылка по остовному дереву, промежуточные узлы пересылают
+    FRAME_BARRIER = 0x02,  ///< сообщение ipc_barrier(), приложению не доставляется
+    FRAME_HEARTBEAT = 0x04,///< пульс детектора отказов, без содержимого
+    FRAME_TIMESTAMP = 0x08,///< за FrameExt идет uint64_t - clock_now_ns() отправителя
+    FRAME_CHECKSUM = 0x10, ///< последним полем идет FrameCheck
+    FRAME_COMPRESSED = 0x20///< payload после полей FrameExt сжат lz_compress()
+};
+
+typedef struct {
+    uint8_t   s_flags;
+    local_id  s_origin;  ///< исходный отправитель (не тот, кто переслал)
+    uint16_t  s_seq;     ///< номер рассылки (эпохи барьера) у s_origin
+} __attribute__((packed)) FrameExt;
+
+// Номер кадра в канале (отправитель, получатель, полоса) и CRC32C всего кадра -
+// заголовка и payload, причем сам s_crc при подсчете равен 0.
+// Ставится на каждом переходе заново, в том числе при пересылке по дереву
+typedef struct {
+    uint16_t  s_chan_seq;
+    uint32_t  s_crc;
+} __attribute__((packed)) FrameCheck;
+
+// Необязательные поля идут за FrameExt в порядке флагов
+static inline size_t frame_ext_len(uint8_t flags) {
+    size_t len = sizeof(FrameExt);
+    if (flags & FRAME_TIMESTAMP) {
+        len += sizeof(uint64_t);
+    }
+    if (flags & FRAME_CHECKSUM) {
+        len += sizeof(FrameCheck);
+    }
+    return len;
+}
+
+// FrameCheck последний, поэтому лежит сразу за остальными полями
+static inline size_t frame_check_offset(uint8_t flags) {
+    return frame_ext_len(flags & ~FRAME_CHECKSUM);
+}
+
+enum {
+    MAX_EXT_PAYLOAD_LEN = MAX_PAYLOAD_LEN - sizeof(FrameExt) - sizeof(uint64_t) - sizeof(FrameCheck)
+};
+
+#endif // IPC_FRAME_H
@@ -0,0 +1,153 @@
+// Просмотр счетчиков IPC работающей группы процессов без их остановки.
+// Сборка: gcc -std=c99 ipcstat.c metrics.c -o ipcstat (-lrt на старых glibc)
+// Запуск: ipcstat <pgid> [период_мс]
+//         ipcstat <pgid> -m  - матрица байт между процессами для IPC_PLACEMENT=traffic
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+
+static const char * const op_names[METRIC_OP_COUNT] = {
+    "send", "receive", "receive_any", "multicast"
+};
+
+// Индексы - значения MessageType; за BALANCE_HISTORY идет TRANSFER_NACK
+// из lab2/codec.h (сам enum в ipc.h менять нельзя)
+static const char * const type_names[METRICS_MAX_TYPES] = {
+    [STARTED] = "STARTED",
+    [DONE] = "DONE",
+    [ACK] = "ACK",
+    [STOP] = "STOP",
+    [TRANSFER] = "TRANSFER",
+    [BALANCE_HISTORY] = "BALANCE_HISTORY",
+    [BALANCE_HISTORY + 1] = "TRANSFER_NACK"
+};
+
+// Перцентиль по гистограмме: нижняя граница корзины, где набралась доля q
+static uint64_t percentile(const uint64_t *hist, uint64_t total, double q) {
+    uint64_t target = (uint64_t)(total * q);
+    uint64_t seen = 0;
+
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > target) {
+            return metrics_bucket_floor(b);
+        }
+    }
+    return metrics_bucket_floor(METRICS_HIST_BUCKETS - 1);
+}
+
+static void print_process(local_id id, const ProcessMetrics *m) {
+    printf("=== Process %d (pid %d), empty polls %llu ===\n",
+           id, m->pid, (unsigned long long)m->empty_polls);
+
+    printf("  %-12s %10s %8s %10s %10s %10s\n", "op", "calls", "errors", "p50 ns", "p99 ns", "p99.9 ns");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        if (m->calls[op] == 0) {
+            continue;
+        }
+        printf("  %-12s %10llu %8llu %10llu %10llu %10llu\n", op_names[op],
+               (unsigned long long)m->calls[op], (unsigned long long)m->errors[op],
+               (unsigned long long)percentile(m->latency[op], m->calls[op], 0.5),
+               (unsigned long long)percentile(m->latency[op], m->calls[op], 0.99),
+               (unsigned long long)percentile(m->latency[op], m->calls[op], 0.999));
+    }
+
+    printf("  %-6s %10s %12s %10s %12s\n", "peer", "msgs out", "bytes out", "msgs in", "bytes in");
+    for (int p = 0; p <= MAX_PROCESS_ID; p++) {
+        const PeerCounters *pc = &m->peer[p];
+        if (pc->msgs_sent == 0 && pc->msgs_recv == 0) {
+            continue;
+        }
+        printf("  %-6d %10llu %12llu %10llu %12llu\n", p,
+               (unsigned long long)pc->msgs_sent, (unsigned long long)pc->bytes_sent,
+               (unsigned long long)pc->msgs_recv, (unsigned long long)pc->bytes_recv);
+    }
+
+    for (int t = 0; t < METRICS_MAX_TYPES; t++) {
+        if (m->type_sent[t] == 0 && m->type_recv[t] == 0) {
+            continue;
+        }
+        const char *name = type_names[t] ? type_names[t] : "?";
+        printf("  type %-2d %-16s out %10llu in %10llu\n", t, name,
+               (unsigned long long)m->type_sent[t], (unsigned long long)m->type_recv[t]);
+    }
+}
+
+// Строка i, столбец j - байты, отправленные процессом i процессу j
+static void print_matrix(const MetricsPage *page) {
+    int count = 0;
+    for (int id = 0; id <= MAX_PROCESS_ID; id++) {
+        if (page->proc[id].pid != 0) {
+            count = id + 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            printf("%s%llu", j ? " " : "", (unsigned long long)page->proc[i].peer[j].bytes_sent);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <pgid> [interval_ms | -m]\n", argv[0]);
+        return 1;
+    }
+
+    int pgid = atoi(argv[1]);
+    int matrix = argc > 2 && strcmp(argv[2], "-m") == 0;
+    int interval_ms = argc > 2 && !matrix ? atoi(argv[2]) : 0;
+
+    char name[64];
+    metrics_shm_name(pgid, name, sizeof(name));
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(name);
+        return 1;
+    }
+
+    const MetricsPage *page = mmap(NULL, sizeof(MetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (page->magic != METRICS_MAGIC || page->version != METRICS_VERSION) {
+        fprintf(stderr, "%s: unknown metrics layout\n", name);
+        return 1;
+    }
+
+    if (matrix) {
+        print_matrix(page);
+        return 0;
+    }
+
+    do {
+        for (local_id id = 0; id <= MAX_PROCESS_ID; id++) {
+            if (__atomic_load_n(&page->proc[id].pid, __ATOMIC_ACQUIRE) != 0) {
+                print_process(id, &page->proc[id]);
+            }
+        }
+
+        if (interval_ms > 0) {
+            struct timespec delay = { interval_ms / 1000, (interval_ms % 1000) * 1000000L };
+            nanosleep(&delay, NULL);
+            printf("\n");
+        }
+    } while (interval_ms > 0);
+
+    return 0;
+}
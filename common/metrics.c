@@ -0,0 +1,136 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+#include "ipc_context.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// Один писатель на слот: атомарные загрузка и запись без lock-префикса,
+// читатель никогда не видит разорванного значения
+#define METRIC_ADD(field, value) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+void metrics_shm_name(int pgid, char *name, size_t size) {
+    snprintf(name, size, "/ipcstat.%d", pgid);
+}
+
+int metrics_bucket(uint64_t value) {
+    if (value < METRICS_LINEAR_BUCKETS) {
+        return (int)value;
+    }
+
+    int exp = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exp - 2)) & (METRICS_SUB_BUCKETS - 1);
+    int bucket = METRICS_LINEAR_BUCKETS + (exp - 3) * METRICS_SUB_BUCKETS + sub;
+
+    return bucket < METRICS_HIST_BUCKETS ? bucket : METRICS_HIST_BUCKETS - 1;
+}
+
+uint64_t metrics_bucket_floor(int bucket) {
+    if (bucket < METRICS_LINEAR_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+
+    int exp = (bucket - METRICS_LINEAR_BUCKETS) / METRICS_SUB_BUCKETS + 3;
+    int sub = (bucket - METRICS_LINEAR_BUCKETS) % METRICS_SUB_BUCKETS;
+    return ((uint64_t)(METRICS_SUB_BUCKETS + sub)) << (exp - 2);
+}
+
+int metrics_attach(void *self) {
+    IPC *ipc = (IPC *)self;
+
+    if (ipc->metrics) {
+        return 0;
+    }
+
+    char name[64];
+    metrics_shm_name(getpgrp(), name, sizeof(name));
+
+    // Создает тот, кто успел первым; ftruncate до того же размера безопасен
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        perror("shm_open metrics failed");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(MetricsPage)) != 0) {
+        perror("ftruncate metrics failed");
+        close(fd);
+        return -1;
+    }
+
+    MetricsPage *page = mmap(NULL, sizeof(MetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap metrics failed");
+        return -1;
+    }
+
+    page->magic = METRICS_MAGIC;
+    page->version = METRICS_VERSION;
+
+    ProcessMetrics *slot = &page->proc[ipc->id];
+    memset(slot, 0, sizeof(ProcessMetrics));
+    __atomic_store_n(&slot->pid, (int32_t)getpid(), __ATOMIC_RELEASE);
+
+    ipc->metrics_page = page;
+    ipc->metrics = slot;
+    return 0;
+}
+
+void metrics_init_from_env(IPC *ipc) {
+    ipc->metrics = NULL;
+    ipc->metrics_page = NULL;
+
+    const char *enabled = getenv("IPC_METRICS");
+    if (enabled && strcmp(enabled, "0") != 0) {
+        metrics_attach(ipc);
+    }
+}
+
+void metrics_detach(IPC *ipc) {
+    if (!ipc->metrics_page) {
+        return;
+    }
+
+    munmap(ipc->metrics_page, sizeof(MetricsPage));
+    ipc->metrics_page = NULL;
+    ipc->metrics = NULL;
+
+    // Родитель завершается последним - он и убирает объект
+    if (ipc->id == PARENT_ID) {
+        char name[64];
+        metrics_shm_name(getpgrp(), name, sizeof(name));
+        shm_unlink(name);
+    }
+}
+
+void metrics_call(ProcessMetrics *m, MetricOp op, int rc, uint64_t elapsed_ns) {
+    METRIC_ADD(m->calls[op], 1);
+    if (rc > 0) {
+        METRIC_ADD(m->empty_polls, 1);
+    } else if (rc < 0) {
+        METRIC_ADD(m->errors[op], 1);
+    }
+    METRIC_ADD(m->latency[op][metrics_bucket(elapsed_ns)], 1);
+}
+
+void metrics_sent(ProcessMetrics *m, local_id peer, const Message *msg) {
+    METRIC_ADD(m->peer[peer].msgs_sent, 1);
+    METRIC_ADD(m->peer[peer].bytes_sent, sizeof(MessageHeader) + msg->s_header.s_payload_len);
+    if (msg->s_header.s_type >= 0 && msg->s_header.s_type < METRICS_MAX_TYPES) {
+        METRIC_ADD(m->type_sent[msg->s_header.s_type], 1);
+    }
+}
+
+void metrics_received(ProcessMetrics *m, local_id peer, const Message *msg) {
+    METRIC_ADD(m->peer[peer].msgs_recv, 1);
+    METRIC_ADD(m->peer[peer].bytes_recv, sizeof(MessageHeader) + msg->s_header.s_payload_len);
+    if (msg->s_header.s_type >= 0 && msg->s_header.s_type < METRICS_MAX_TYPES) {
+        METRIC_ADD(m->type_recv[msg->s_header.s_type], 1);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "ipc.h"
+
+// Счетчики IPC в разделяемой памяти /ipcstat.<pgid>: у каждого local_id свой
+// слот, пишет в него только владелец, а ipcstat читает все слоты на ходу.
+// Включается переменной окружения IPC_METRICS=1 или вызовом metrics_attach().
+
+enum {
+    METRICS_MAGIC = 0x49504353,  ///< "IPCS"
+    METRICS_VERSION = 1,
+    METRICS_MAX_TYPES = 16,      ///< счетчики по MessageType для s_type < METRICS_MAX_TYPES
+    METRICS_LINEAR_BUCKETS = 8,  ///< 0..7 нс по одному значению на корзину
+    METRICS_SUB_BUCKETS = 4,     ///< дальше 4 корзины на каждую степень двойки
+    METRICS_HIST_BUCKETS = 128   ///< последняя корзина - все от ~7.5 с
+};
+
+typedef enum {
+    METRIC_OP_SEND = 0,
+    METRIC_OP_RECEIVE,
+    METRIC_OP_RECEIVE_ANY,
+    METRIC_OP_MULTICAST,
+    METRIC_OP_COUNT
+} MetricOp;
+
+// Кадры в канале как есть: с пересылками дерева, барьером и пульсом
+typedef struct {
+    uint64_t msgs_sent;
+    uint64_t bytes_sent;
+    uint64_t msgs_recv;
+    uint64_t bytes_recv;
+} PeerCounters;
+
+typedef struct {
+    int32_t pid;                ///< 0 - слот не занят
+    int32_t reserved;
+    uint64_t calls[METRIC_OP_COUNT];
+    uint64_t errors[METRIC_OP_COUNT];
+    uint64_t empty_polls;       ///< receive_any() дождался конца ожидания, ничего не прочитав;
+                                ///< отказ соседа или EOF идут в errors
+    uint64_t latency[METRIC_OP_COUNT][METRICS_HIST_BUCKETS];  ///< длительность вызовов, нс
+    uint64_t type_sent[METRICS_MAX_TYPES];
+    uint64_t type_recv[METRICS_MAX_TYPES];
+    PeerCounters peer[MAX_PROCESS_ID + 1];
+} ProcessMetrics;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    ProcessMetrics proc[MAX_PROCESS_ID + 1];
+} MetricsPage;
+
+/** Имя объекта разделяемой памяти для группы процессов pgid.
+ */
+void metrics_shm_name(int pgid, char * name, size_t size);
+
+/** Подключить счетчики процесса к /ipcstat.<pgid текущего процесса>.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int metrics_attach(void * self);
+
+/** Номер корзины гистограммы для значения value (лог-линейная шкала).
+ */
+int metrics_bucket(uint64_t value);
+
+/** Нижняя граница значений корзины bucket.
+ */
+uint64_t metrics_bucket_floor(int bucket);
+
+#endif // METRICS_H
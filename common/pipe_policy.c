@@ -0,0 +1,87 @@
+#define _GNU_SOURCE
+
+#include "ipc_context.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Загружается один раз: узлы-потоки спрашивают емкость одновременно
+static IpcPipePolicy pipe_policy = {
+    IPC_PIPE_TO_PARENT_DEFAULT,
+    0,
+    IPC_PIPE_BULK_DEFAULT
+};
+static pthread_once_t pipe_policy_once = PTHREAD_ONCE_INIT;
+
+// "256K", "1M" или число байт
+static int parse_size(const char *text, char **end) {
+    long value = strtol(text, end, 10);
+    if (**end == 'K' || **end == 'k') {
+        value <<= 10;
+        (*end)++;
+    } else if (**end == 'M' || **end == 'm') {
+        value <<= 20;
+        (*end)++;
+    }
+    return value > 0 && value <= (1 << 30) ? (int)value : 0;
+}
+
+// IPC_PIPE_SIZE=to_parent,peer,bulk; пустое поле оставляет значение по умолчанию
+static void pipe_policy_from_env(void) {
+    const char *value = getenv("IPC_PIPE_SIZE");
+    if (!value) {
+        return;
+    }
+
+    int *fields[] = { &pipe_policy.to_parent, &pipe_policy.peer, &pipe_policy.bulk };
+    const char *pos = value;
+    for (size_t k = 0; k < sizeof(fields) / sizeof(fields[0]) && *pos; k++) {
+        char *end = (char *)pos;
+        if (*pos != ',') {
+            *fields[k] = parse_size(pos, &end);
+        }
+        pos = *end == ',' ? end + 1 : end;
+    }
+}
+
+static void pipe_policy_keep(void) {
+}
+
+void ipc_set_pipe_policy(const IpcPipePolicy *policy) {
+    pthread_once(&pipe_policy_once, pipe_policy_keep);
+    pipe_policy = *policy;
+}
+
+int pipe_capacity_for(local_id from, local_id to, int lane) {
+    (void)from;
+    pthread_once(&pipe_policy_once, pipe_policy_from_env);
+    if (lane == IPC_LANE_BULK) {
+        return pipe_policy.bulk;
+    }
+    return to == PARENT_ID ? pipe_policy.to_parent : pipe_policy.peer;
+}
+
+int pipe_set_capacity(int fd, int bytes) {
+    if (bytes > 0) {
+        // Выше /proc/sys/fs/pipe-max-size без CAP_SYS_RESOURCE нельзя - остается прежний размер
+        fcntl(fd, F_SETPIPE_SZ, bytes);
+    }
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+int ipc_set_channel_capacity(void *self, local_id dst, int lane, int bytes) {
+    IPC *ipc = (IPC *)self;
+    if (ipc->mem || dst < 0 || dst >= ipc->process_count || dst == ipc->id ||
+        lane < 0 || lane >= ipc->lanes) {
+        return -1;
+    }
+
+    Pipe *pipe = &ipc->pipes[ipc->id][dst];
+    int fd = lane == IPC_LANE_BULK ? pipe->bulk_write_fd : pipe->write_fd;
+    if (fd < 0) {
+        return -1;
+    }
+    return pipe_set_capacity(fd, bytes);
+}
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+
+#include "placement.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+enum {
+    PLACEMENT_MAX_CPUS = 1024,
+    PLACEMENT_MAX_NODES = 16
+};
+
+// CPU, разрешенные процессу, сгруппированные по NUMA-узлам
+typedef struct {
+    int node_count;
+    int cpu_count[PLACEMENT_MAX_NODES];
+    int cpus[PLACEMENT_MAX_NODES][PLACEMENT_MAX_CPUS];
+} CpuTopology;
+
+// Разбор списка вида "0-3,8,10-11" из sysfs
+static void parse_cpulist(const char *list, const cpu_set_t *allowed, CpuTopology *topo, int node) {
+    const char *pos = list;
+
+    while (*pos) {
+        char *end;
+        long first = strtol(pos, &end, 10);
+        if (end == pos) {
+            break;
+        }
+        long last = first;
+        if (*end == '-') {
+            pos = end + 1;
+            last = strtol(pos, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < PLACEMENT_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, allowed)) {
+                topo->cpus[node][topo->cpu_count[node]++] = (int)cpu;
+            }
+        }
+        pos = (*end == ',') ? end + 1 : end;
+        if (*pos == '\n') {
+            break;
+        }
+    }
+}
+
+static int load_topology(CpuTopology *topo) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity failed");
+        return -1;
+    }
+
+    memset(topo, 0, sizeof(CpuTopology));
+
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char list[1024];
+        if (fgets(list, sizeof(list), file)) {
+            parse_cpulist(list, &allowed, topo, topo->node_count);
+            if (topo->cpu_count[topo->node_count] > 0) {
+                topo->node_count++;
+            }
+        }
+        fclose(file);
+    }
+
+    // Без NUMA в sysfs считаем всю машину одним узлом
+    if (topo->node_count == 0) {
+        for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                topo->cpus[0][topo->cpu_count[0]++] = cpu;
+            }
+        }
+        topo->node_count = 1;
+    }
+
+    return topo->cpu_count[0] > 0 ? 0 : -1;
+}
+
+int placement_parse(const char *name, PlacementPolicy *policy) {
+    static const char * const names[] = { "none", "compact", "scatter", "traffic" };
+
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *policy = (PlacementPolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Жадная раскладка: процессы по убыванию общего трафика, каждый - на узел,
+// с которым у него больше всего обмена среди уже размещенных (пока есть место)
+static void plan_traffic(const CpuTopology *topo, int process_count,
+                         const uint64_t traffic[][MAX_PROCESS_ID + 1], int *node_of) {
+    uint64_t total[MAX_PROCESS_ID + 1] = { 0 };
+    int order[MAX_PROCESS_ID + 1];
+    int used[PLACEMENT_MAX_NODES] = { 0 };
+
+    for (int i = 0; i < process_count; i++) {
+        order[i] = i;
+        node_of[i] = -1;
+        for (int j = 0; j < process_count; j++) {
+            total[i] += traffic[i][j] + traffic[j][i];
+        }
+    }
+    for (int i = 1; i < process_count; i++) {
+        for (int k = i; k > 0 && total[order[k]] > total[order[k - 1]]; k--) {
+            int tmp = order[k];
+            order[k] = order[k - 1];
+            order[k - 1] = tmp;
+        }
+    }
+
+    for (int k = 0; k < process_count; k++) {
+        int p = order[k];
+        int best = -1;
+        uint64_t best_affinity = 0;
+
+        for (int node = 0; node < topo->node_count; node++) {
+            if (used[node] >= topo->cpu_count[node]) {
+                continue;
+            }
+            uint64_t affinity = 0;
+            for (int q = 0; q < process_count; q++) {
+                if (node_of[q] == node) {
+                    affinity += traffic[p][q] + traffic[q][p];
+                }
+            }
+            if (best < 0 || affinity > best_affinity) {
+                best = node;
+                best_affinity = affinity;
+            }
+        }
+
+        // Процессов больше, чем CPU: дальше по кругу
+        node_of[p] = best >= 0 ? best : p % topo->node_count;
+        used[node_of[p]]++;
+    }
+}
+
+int placement_plan(PlacementPolicy policy, int process_count,
+                   const uint64_t traffic[][MAX_PROCESS_ID + 1], int *cpu_of) {
+    if (process_count <= 0 || process_count > MAX_PROCESS_ID + 1) {
+        return -1;
+    }
+
+    CpuTopology *topo = malloc(sizeof(CpuTopology));
+    if (!topo || load_topology(topo) != 0) {
+        free(topo);
+        return -1;
+    }
+
+    int node_of[MAX_PROCESS_ID + 1];
+    int next[PLACEMENT_MAX_NODES] = { 0 };
+    int rc = 0;
+
+    switch (policy) {
+        case PLACEMENT_COMPACT: {
+            int node = 0;
+            for (int i = 0; i < process_count; i++) {
+                while (next[node] >= topo->cpu_count[node]) {
+                    node = (node + 1) % topo->node_count;
+                    if (node == 0) {
+                        memset(next, 0, sizeof(next));
+                    }
+                }
+                cpu_of[i] = topo->cpus[node][next[node]++];
+            }
+            break;
+        }
+        case PLACEMENT_SCATTER:
+            for (int i = 0; i < process_count; i++) {
+                int node = i % topo->node_count;
+                cpu_of[i] = topo->cpus[node][next[node]++ % topo->cpu_count[node]];
+            }
+            break;
+        case PLACEMENT_TRAFFIC:
+            if (!traffic) {
+                rc = -1;
+                break;
+            }
+            plan_traffic(topo, process_count, traffic, node_of);
+            for (int i = 0; i < process_count; i++) {
+                int node = node_of[i];
+                cpu_of[i] = topo->cpus[node][next[node]++ % topo->cpu_count[node]];
+            }
+            break;
+        default:
+            rc = -1;
+            break;
+    }
+
+    free(topo);
+    return rc;
+}
+
+int placement_pin(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int load_matrix(const char *path, int process_count, uint64_t traffic[][MAX_PROCESS_ID + 1]) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    for (int i = 0; i < process_count; i++) {
+        for (int j = 0; j < process_count; j++) {
+            unsigned long long value;
+            if (fscanf(file, "%llu", &value) != 1) {
+                fprintf(stderr, "%s: expected %dx%d matrix\n", path, process_count, process_count);
+                fclose(file);
+                return -1;
+            }
+            traffic[i][j] = value;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int placement_apply_from_env(local_id id, int process_count) {
+    const char *name = getenv("IPC_PLACEMENT");
+    if (!name) {
+        return 0;
+    }
+
+    PlacementPolicy policy;
+    if (placement_parse(name, &policy) != 0) {
+        fprintf(stderr, "Unknown IPC_PLACEMENT policy: %s\n", name);
+        return -1;
+    }
+    if (policy == PLACEMENT_NONE) {
+        return 0;
+    }
+
+    static uint64_t traffic[MAX_PROCESS_ID + 1][MAX_PROCESS_ID + 1];
+    if (policy == PLACEMENT_TRAFFIC) {
+        const char *path = getenv("IPC_PLACEMENT_MATRIX");
+        if (!path || load_matrix(path, process_count, traffic) != 0) {
+            return -1;
+        }
+    }
+
+    int cpu_of[MAX_PROCESS_ID + 1];
+    if (placement_plan(policy, process_count, traffic, cpu_of) != 0) {
+        return -1;
+    }
+    return placement_pin(cpu_of[id]);
+}
@@ -0,0 +1,50 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "ipc.h"
+
+// Привязка процессов к процессорам по local_id.
+// Вызывается в самом начале работы процесса, до выделения буферов IPC:
+// память, которой процесс касается первым, ядро выделяет на его NUMA-узле.
+
+typedef enum {
+    PLACEMENT_NONE = 0,
+    PLACEMENT_COMPACT,   ///< подряд: сначала все CPU узла 0, затем узла 1...
+    PLACEMENT_SCATTER,   ///< по кругу между NUMA-узлами
+    PLACEMENT_TRAFFIC    ///< активно общающиеся процессы - на один узел
+} PlacementPolicy;
+
+/** Разобрать имя политики ("none", "compact", "scatter", "traffic").
+ *
+ * @return 0 on success, -1 если имя неизвестно
+ */
+int placement_parse(const char * name, PlacementPolicy * policy);
+
+/** Рассчитать CPU для каждого из process_count процессов.
+ *
+ * @param traffic   Объем обмена между процессами (байты в обе стороны
+ *                  складываются), нужен только для PLACEMENT_TRAFFIC
+ * @param cpu_of    Результат: номер CPU для каждого local_id
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int placement_plan(PlacementPolicy policy, int process_count,
+                   const uint64_t traffic[][MAX_PROCESS_ID + 1], int * cpu_of);
+
+/** Привязать текущий процесс к CPU.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int placement_pin(int cpu);
+
+/** Привязать процесс id по переменной окружения IPC_PLACEMENT.
+ *
+ * Для traffic матрица берется из файла IPC_PLACEMENT_MATRIX
+ * (process_count строк по process_count чисел, см. ipcstat -m).
+ * Без IPC_PLACEMENT ничего не делает.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int placement_apply_from_env(local_id id, int process_count);
+
+#endif // PLACEMENT_H
@@ -0,0 +1,140 @@
+#include "replay.h"
+#include "ipc_context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Заголовок журнала: сигнатура, версия, local_id записавшего процесса
+static const char replay_signature[4] = { 'I', 'P', 'C', 'R' };
+
+enum {
+    REPLAY_VERSION = 1,
+    REPLAY_HEADER_LEN = 6,
+    REPLAY_RECORD_LEN = 3
+};
+
+int replay_open(void *self, ReplayMode mode, const char *path) {
+    IPC *ipc = (IPC *)self;
+    ReplayState *rp = &ipc->replay;
+
+    replay_close(self);
+
+    if (mode == REPLAY_RECORD) {
+        rp->file = fopen(path, "wb");
+        if (!rp->file) {
+            perror("fopen replay log failed");
+            return -1;
+        }
+
+        uint8_t header[REPLAY_HEADER_LEN];
+        memcpy(header, replay_signature, sizeof(replay_signature));
+        header[4] = REPLAY_VERSION;
+        header[5] = (uint8_t)ipc->id;
+        fwrite(header, 1, sizeof(header), rp->file);
+    } else if (mode == REPLAY_REPLAY) {
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            perror("fopen replay log failed");
+            return -1;
+        }
+
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        rp->log = malloc(size > 0 ? size : 1);
+        if (!rp->log || size < REPLAY_HEADER_LEN ||
+            fread(rp->log, 1, size, file) != (size_t)size ||
+            memcmp(rp->log, replay_signature, sizeof(replay_signature)) != 0 ||
+            rp->log[4] != REPLAY_VERSION || rp->log[5] != (uint8_t)ipc->id) {
+            fprintf(stderr, "%s: not a replay log of process %d\n", path, ipc->id);
+            fclose(file);
+            free(rp->log);
+            rp->log = NULL;
+            return -1;
+        }
+        fclose(file);
+
+        rp->log_len = size;
+        rp->cursor = REPLAY_HEADER_LEN;
+    }
+
+    rp->mode = mode;
+    return 0;
+}
+
+void replay_close(void *self) {
+    IPC *ipc = (IPC *)self;
+    ReplayState *rp = &ipc->replay;
+
+    if (rp->file) {
+        fclose(rp->file);
+        rp->file = NULL;
+    }
+    free(rp->log);
+    rp->log = NULL;
+    rp->log_len = 0;
+    rp->cursor = 0;
+    rp->mode = REPLAY_OFF;
+}
+
+void replay_init_from_env(IPC *ipc) {
+    memset(&ipc->replay, 0, sizeof(ReplayState));
+
+    const char *mode = getenv("IPC_REPLAY");
+    if (!mode) {
+        return;
+    }
+
+    const char *dir = getenv("IPC_REPLAY_DIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/replay_%d.log", dir ? dir : ".", ipc->id);
+
+    if (strcmp(mode, "record") == 0) {
+        replay_open(ipc, REPLAY_RECORD, path);
+    } else if (strcmp(mode, "replay") == 0) {
+        replay_open(ipc, REPLAY_REPLAY, path);
+    }
+}
+
+void replay_record(IPC *ipc, local_id from) {
+    ReplayState *rp = &ipc->replay;
+    if (rp->mode != REPLAY_RECORD) {
+        return;
+    }
+
+    // Буферизация stdio: системный вызов раз в несколько тысяч записей
+    uint16_t seq = ipc->recv_seq[from];
+    uint8_t record[REPLAY_RECORD_LEN] = { (uint8_t)from, seq & 0xFF, seq >> 8 };
+    fwrite(record, 1, sizeof(record), rp->file);
+}
+
+int replay_next_peer(IPC *ipc, local_id *from) {
+    ReplayState *rp = &ipc->replay;
+    if (rp->mode != REPLAY_REPLAY) {
+        return -1;
+    }
+
+    if (rp->cursor + REPLAY_RECORD_LEN > rp->log_len) {
+        // Журнал кончился - дальше обычный недетерминированный режим
+        log_event(ipc->events_log, "Process %d: replay log exhausted", ipc->id);
+        replay_close(ipc);
+        return -1;
+    }
+
+    *from = (local_id)rp->log[rp->cursor];
+    return 0;
+}
+
+void replay_advance(IPC *ipc, local_id from) {
+    ReplayState *rp = &ipc->replay;
+    const uint8_t *record = rp->log + rp->cursor;
+    uint16_t seq = record[1] | (record[2] << 8);
+
+    if (seq != ipc->recv_seq[from]) {
+        log_event(ipc->events_log, "Process %d: replay diverged, expected seq %d from %d, got %d",
+                  ipc->id, seq, from, ipc->recv_seq[from]);
+    }
+    rp->cursor += REPLAY_RECORD_LEN;
+}
@@ -0,0 +1,31 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "ipc.h"
+
+// Запись и воспроизведение порядка доставки receive_any().
+// При записи на каждый возврат receive_any() в журнал процесса пишется
+// 3 байта: от кого пришло сообщение и его номер в канале. При воспроизведении
+// receive_any() ждет именно записанного соседа, так что порядок обработки
+// сообщений совпадает с записанным запуском.
+//
+// Включается переменной окружения IPC_REPLAY=record|replay при создании IPC,
+// журнал процесса - replay_<local_id>.log (каталог задает IPC_REPLAY_DIR).
+
+typedef enum {
+    REPLAY_OFF = 0,
+    REPLAY_RECORD,
+    REPLAY_REPLAY
+} ReplayMode;
+
+/** Начать запись или воспроизведение с журналом path.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+int replay_open(void * self, ReplayMode mode, const char * path);
+
+/** Дописать журнал на диск и выключить запись/воспроизведение.
+ */
+void replay_close(void * self);
+
+#endif // REPLAY_H
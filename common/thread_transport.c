@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+
+#include "thread_transport.h"
+#include "clock.h"
+#include "common.h"
+#include "coroutine.h"
+#include "ipc_context.h"
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Кусок потока байт: ровно то, что отправитель записал одним write_bytes()
+typedef struct MemChunk {
+    struct MemChunk *next;
+    size_t len;
+    size_t off;    // сколько уже прочитано потребителем
+    char *data;
+} MemChunk;
+
+// Очередь Вьюкова (MPSC без блокировок): производители меняют только head,
+// потребитель - только tail
+typedef struct {
+    MemChunk *head;
+    MemChunk *tail;
+    MemChunk stub;
+    MemChunk *front;   // извлеченный, но не дочитанный кусок
+} MemQueue;
+
+struct MemTransport {
+    int process_count;
+    MemQueue channels[IPC_LANES][MAX_PROCESS_ID + 1][MAX_PROCESS_ID + 1];  // [lane][from][to]
+    // Звонок получателя: счетчик записей, на нем спят в futex
+    uint32_t doorbell[MAX_PROCESS_ID + 1];
+    uint32_t waiters[MAX_PROCESS_ID + 1];
+    Scheduler *sched;     // узлы-сопрограммы: будить через планировщик, а не futex
+};
+
+static __thread IPC *thread_self = NULL;
+
+static void queue_init(MemQueue *q) {
+    memset(q, 0, sizeof(MemQueue));
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+static void queue_push(MemQueue *q, MemChunk *chunk) {
+    chunk->next = NULL;
+    MemChunk *prev = __atomic_exchange_n(&q->head, chunk, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, chunk, __ATOMIC_RELEASE);
+}
+
+// NULL - пусто или производитель еще не дописал ссылку next
+static MemChunk *queue_pop(MemQueue *q) {
+    MemChunk *tail = q->tail;
+    MemChunk *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (!next) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    queue_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static int queue_nonempty(MemQueue *q) {
+    if (q->front && q->front->off < q->front->len) {
+        return 1;
+    }
+    MemChunk *tail = q->tail;
+    return tail != &q->stub || __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE) != NULL;
+}
+
+MemTransport *mem_transport_create(int process_count) {
+    MemTransport *mem = calloc(1, sizeof(MemTransport));
+    if (!mem) {
+        perror("malloc memory transport failed");
+        exit(1);
+    }
+
+    mem->process_count = process_count;
+    for (int lane = 0; lane < IPC_LANES; lane++) {
+        for (int i = 0; i <= MAX_PROCESS_ID; i++) {
+            for (int j = 0; j <= MAX_PROCESS_ID; j++) {
+                queue_init(&mem->channels[lane][i][j]);
+            }
+        }
+    }
+    return mem;
+}
+
+void mem_transport_destroy(MemTransport *mem) {
+    if (!mem) {
+        return;
+    }
+
+    for (int lane = 0; lane < IPC_LANES; lane++) {
+        for (int i = 0; i < mem->process_count; i++) {
+            for (int j = 0; j < mem->process_count; j++) {
+                MemQueue *q = &mem->channels[lane][i][j];
+                MemChunk *chunk;
+                free(q->front);
+                while ((chunk = queue_pop(q)) != NULL) {
+                    if (chunk != &q->stub) {
+                        free(chunk);
+                    }
+                }
+            }
+        }
+    }
+    free(mem);
+}
+
+static long futex(uint32_t *addr, int op, uint32_t value, const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+}
+
+int mem_channel_write(MemTransport *mem, int lane, local_id from, local_id to, const void *data, size_t len) {
+    MemChunk *chunk = malloc(sizeof(MemChunk) + len);
+    if (!chunk) {
+        return -1;
+    }
+    chunk->len = len;
+    chunk->off = 0;
+    chunk->data = (char *)(chunk + 1);
+    memcpy(chunk->data, data, len);
+
+    queue_push(&mem->channels[lane][from][to], chunk);
+
+    // Будим получателя, только если он спит: в горячем цикле системных вызовов нет
+    __atomic_add_fetch(&mem->doorbell[to], 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mem->waiters[to], __ATOMIC_SEQ_CST) > 0) {
+        if (mem->sched) {
+            scheduler_wake(mem->sched, to);
+        } else {
+            futex(&mem->doorbell[to], FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+        }
+    }
+    return 0;
+}
+
+ssize_t mem_channel_read(MemTransport *mem, int lane, local_id from, local_id to, void *buf, size_t len) {
+    MemQueue *q = &mem->channels[lane][from][to];
+    size_t done = 0;
+
+    while (done < len) {
+        if (!q->front || q->front->off == q->front->len) {
+            free(q->front);
+            q->front = NULL;
+
+            if (!queue_nonempty(q)) {
+                break;
+            }
+            // Производитель между обменом head и записью next - это наносекунды
+            while ((q->front = queue_pop(q)) == NULL) {
+                sched_yield();
+            }
+        }
+
+        size_t part = q->front->len - q->front->off;
+        if (part > len - done) {
+            part = len - done;
+        }
+        memcpy((char *)buf + done, q->front->data + q->front->off, part);
+        q->front->off += part;
+        done += part;
+    }
+
+    return (ssize_t)done;
+}
+
+int mem_channel_ready(MemTransport *mem, int lane, local_id from, local_id to) {
+    return queue_nonempty(&mem->channels[lane][from][to]);
+}
+
+int mem_transport_wait(MemTransport *mem, local_id to, WaitReadyFn ready, void *arg, int timeout_ms) {
+    int64_t deadline = timeout_ms >= 0 ? (int64_t)(clock_now_ns() + (uint64_t)timeout_ms * 1000000) : -1;
+    Coroutine *co = coroutine_current();
+
+    __atomic_add_fetch(&mem->waiters[to], 1, __ATOMIC_SEQ_CST);
+
+    // Звонок мог быть от уже прочитанного кадра - проверяем готовность заново
+    int rc;
+    while (1) {
+        uint32_t seen = __atomic_load_n(&mem->doorbell[to], __ATOMIC_SEQ_CST);
+        if (ready(arg)) {
+            rc = 1;
+            break;
+        }
+
+        int64_t left = -1;
+        if (deadline >= 0) {
+            left = deadline - (int64_t)clock_now_ns();
+            if (left <= 0) {
+                rc = 0;
+                break;
+            }
+        }
+
+        if (co) {
+            // Сопрограмма не блокирует поток, а уступает его до записи или таймаута
+            coroutine_park(co, deadline);
+            continue;
+        }
+
+        // Запись после чтения seen изменит doorbell, и futex вернется сразу
+        struct timespec timeout;
+        timeout.tv_sec = left / 1000000000;
+        timeout.tv_nsec = left % 1000000000;
+        futex(&mem->doorbell[to], FUTEX_WAIT_PRIVATE, seen, left >= 0 ? &timeout : NULL);
+    }
+
+    __atomic_sub_fetch(&mem->waiters[to], 1, __ATOMIC_SEQ_CST);
+    return rc;
+}
+
+void mem_transport_set_scheduler(MemTransport *mem, Scheduler *sched) {
+    mem->sched = sched;
+}
+
+int prepare_shared_logs(void) {
+    // Общие для всех узлов вещи готовим до старта потоков, чтобы не гоняться за ними
+    clock_now_ns();
+
+    const char *logs[] = { events_log, pipes_log };
+    for (int i = 0; i < 2; i++) {
+        FILE *file = fopen(logs[i], "w");
+        if (!file) {
+            perror("fopen log failed");
+            return -1;
+        }
+        fclose(file);
+    }
+    return 0;
+}
+
+typedef struct {
+    MemTransport *mem;
+    local_id id;
+    int process_count;
+    ThreadEntry entry;
+    void *arg;
+    int rc;
+} ThreadNode;
+
+static void *thread_main(void *arg) {
+    ThreadNode *node = (ThreadNode *)arg;
+
+    IPC *ipc = init_ipc_threaded(node->id, node->process_count, node->mem);
+    thread_self = ipc;
+
+    node->rc = node->entry(ipc, node->id, node->arg);
+
+    cleanup_ipc(ipc);
+    thread_self = NULL;
+    return NULL;
+}
+
+void *ipc_self(void) {
+    Coroutine *co = coroutine_current();
+    if (co) {
+        return coroutine_ipc(co);
+    }
+    return thread_self;
+}
+
+int ipc_run_threads(int process_count, ThreadEntry entry, void *arg) {
+    if (process_count <= 0 || process_count > MAX_PROCESS_ID + 1) {
+        return -1;
+    }
+
+    if (prepare_shared_logs() != 0) {
+        return -1;
+    }
+
+    MemTransport *mem = mem_transport_create(process_count);
+    ThreadNode nodes[MAX_PROCESS_ID + 1];
+    pthread_t threads[MAX_PROCESS_ID + 1];
+
+    for (int i = 0; i < process_count; i++) {
+        nodes[i].mem = mem;
+        nodes[i].id = (local_id)i;
+        nodes[i].process_count = process_count;
+        nodes[i].entry = entry;
+        nodes[i].arg = arg;
+        nodes[i].rc = -1;
+
+        if (pthread_create(&threads[i], NULL, thread_main, &nodes[i]) != 0) {
+            perror("pthread_create failed");
+            exit(1);
+        }
+    }
+
+    int rc = 0;
+    for (int i = 0; i < process_count; i++) {
+        pthread_join(threads[i], NULL);
+        if (nodes[i].rc != 0) {
+            rc = -1;
+        }
+    }
+
+    mem_transport_destroy(mem);
+    return rc;
+}
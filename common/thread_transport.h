@@ -0,0 +1,32 @@
+#ifndef THREAD_TRANSPORT_H
+#define THREAD_TRANSPORT_H
+
+#include "ipc.h"
+
+// Режим одного процесса: каждый local_id - поток, каналы - очереди в памяти
+// вместо pipe. API ipc.h не меняется, код протокола работает как есть.
+
+/** Тело узла. self - его IPC-контекст для send()/receive(), тот же,
+ * что возвращает ipc_self() в этом потоке.
+ *
+ * @return 0 on success, any non-zero value on error
+ */
+typedef int (*ThreadEntry)(void * self, local_id id, void * arg);
+
+/** Запустить process_count узлов потоками и дождаться их завершения.
+ *
+ * @return 0 если все узлы вернули 0, иначе -1
+ */
+int ipc_run_threads(int process_count, ThreadEntry entry, void * arg);
+
+/** IPC-контекст узла, которому принадлежит текущий поток (NULL вне ipc_run_threads).
+ */
+void * ipc_self(void);
+
+/** PA1 в режиме потоков: ipc_run_threads(n, child_thread, NULL), то же тело
+ * подходит и для ipc_run_coroutines(). main() PA1 в дерево не входит;
+ * режим из окружения (IPC_MODE) выбирает только lab2.
+ */
+int child_thread(void * self, local_id id, void * arg);
+
+#endif // THREAD_TRANSPORT_H
@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include "ipc_context.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+
+// Узлы-потоки читают топологию одновременно - загружается она ровно один раз
+static IpcTopology topology = { IPC_TOPOLOGY_MESH, { 0 } };
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+static void add_link(IpcTopology *topo, int from, int to) {
+    topo->links[from] |= (uint16_t)(1u << to);
+}
+
+// Ребра custom: "a-b" - в обе стороны, "a>b" - только от a к b; разделители - запятые,
+// пробелы и переводы строк, '#' - комментарий до конца строки
+static int parse_links(const char *text, IpcTopology *topo) {
+    const char *pos = text;
+    while (*pos) {
+        if (*pos == '#') {
+            while (*pos && *pos != '\n') {
+                pos++;
+            }
+            continue;
+        }
+        if (isspace((unsigned char)*pos) || *pos == ',') {
+            pos++;
+            continue;
+        }
+
+        char *end;
+        long from = strtol(pos, &end, 10);
+        char kind = *end;
+        if (end == pos || (kind != '-' && kind != '>')) {
+            return -1;
+        }
+        pos = end + 1;
+        long to = strtol(pos, &end, 10);
+        if (end == pos || from < 0 || to < 0 || from > MAX_PROCESS_ID || to > MAX_PROCESS_ID || from == to) {
+            return -1;
+        }
+        pos = end;
+
+        add_link(topo, (int)from, (int)to);
+        if (kind == '-') {
+            add_link(topo, (int)to, (int)from);
+        }
+    }
+    return 0;
+}
+
+int ipc_topology_parse(const char *spec, IpcTopology *topo) {
+    memset(topo, 0, sizeof(IpcTopology));
+
+    if (strcmp(spec, "mesh") == 0) {
+        topo->kind = IPC_TOPOLOGY_MESH;
+    } else if (strcmp(spec, "star") == 0) {
+        topo->kind = IPC_TOPOLOGY_STAR;
+    } else if (strcmp(spec, "ring") == 0) {
+        topo->kind = IPC_TOPOLOGY_RING;
+    } else if (strncmp(spec, "custom:", 7) == 0) {
+        topo->kind = IPC_TOPOLOGY_CUSTOM;
+        return parse_links(spec + 7, topo);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int ipc_topology_load(const char *path, IpcTopology *topo) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    char text[4096];
+    size_t len = fread(text, 1, sizeof(text) - 1, file);
+    int too_long = !feof(file);
+    fclose(file);
+    if (too_long) {
+        return -1;
+    }
+    text[len] = '\0';
+
+    // Первое слово - вид топологии, дальше для custom идут ребра
+    char *pos = text;
+    while (isspace((unsigned char)*pos)) {
+        pos++;
+    }
+    char *word_end = pos;
+    while (*word_end && !isspace((unsigned char)*word_end)) {
+        word_end++;
+    }
+    char kind[16];
+    size_t kind_len = (size_t)(word_end - pos);
+    if (kind_len == 0 || kind_len >= sizeof(kind)) {
+        return -1;
+    }
+    memcpy(kind, pos, kind_len);
+    kind[kind_len] = '\0';
+
+    if (strcmp(kind, "custom") == 0) {
+        memset(topo, 0, sizeof(IpcTopology));
+        topo->kind = IPC_TOPOLOGY_CUSTOM;
+        return parse_links(word_end, topo);
+    }
+    return ipc_topology_parse(kind, topo);
+}
+
+// IPC_TOPOLOGY=mesh|star|ring|custom:... или @путь к файлу
+static void topology_from_env(void) {
+    const char *value = getenv("IPC_TOPOLOGY");
+    if (!value) {
+        return;
+    }
+
+    IpcTopology topo;
+    int rc = value[0] == '@' ? ipc_topology_load(value + 1, &topo) : ipc_topology_parse(value, &topo);
+    if (rc != 0) {
+        fprintf(stderr, "IPC_TOPOLOGY=%s is invalid, using full mesh\n", value);
+        return;
+    }
+    topology = topo;
+}
+
+static void topology_keep(void) {
+}
+
+void ipc_set_topology(const IpcTopology *topo) {
+    // Заданная явно топология не перезаписывается переменной окружения
+    pthread_once(&topology_once, topology_keep);
+    topology = *topo;
+}
+
+int topology_has_link(local_id from, local_id to, int process_count) {
+    pthread_once(&topology_once, topology_from_env);
+    if (from == to) {
+        return 0;
+    }
+
+    switch (topology.kind) {
+        case IPC_TOPOLOGY_STAR:
+            return from == PARENT_ID || to == PARENT_ID;
+        case IPC_TOPOLOGY_RING:
+            return (from + 1) % process_count == to || (to + 1) % process_count == from;
+        case IPC_TOPOLOGY_CUSTOM:
+            return (topology.links[from] >> to) & 1;
+        case IPC_TOPOLOGY_MESH:
+        default:
+            return 1;
+    }
+}
+
+int ipc_topology_complete(int process_count) {
+    for (local_id from = 0; from < process_count; from++) {
+        for (local_id to = 0; to < process_count; to++) {
+            if (from != to && !topology_has_link(from, to, process_count)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int topology_is_mesh(void) {
+    pthread_once(&topology_once, topology_from_env);
+    return topology.kind == IPC_TOPOLOGY_MESH;
+}
+
+// Байт в pipe, еще не прочитанных; FIONREAD работает на любом конце
+static int pipe_queued(int fd) {
+    int bytes;
+    if (fd < 0 || ioctl(fd, FIONREAD, &bytes) != 0) {
+        return 0;
+    }
+    return bytes;
+}
+
+int ipc_channel_info(void *self, local_id peer, IpcChannelInfo *info) {
+    IPC *ipc = (IPC *)self;
+    if (peer < 0 || peer >= ipc->process_count || peer == ipc->id) {
+        return -1;
+    }
+
+    memset(info, 0, sizeof(IpcChannelInfo));
+    info->lanes = ipc->lanes;
+    info->writable = channel_writable(ipc, peer);
+    info->readable = ipc->mem ? topology_has_link(peer, ipc->id, ipc->process_count)
+                              : ipc->pipes[peer][ipc->id].read_fd >= 0;
+    info->sent_msgs = ipc->traffic[peer].sent_msgs;
+    info->sent_bytes = ipc->traffic[peer].sent_bytes;
+    info->received_msgs = ipc->traffic[peer].received_msgs;
+    info->received_bytes = ipc->traffic[peer].received_bytes;
+
+    if (ipc->mem) {
+        info->backend = info->writable || info->readable ? IPC_BACKEND_MEMORY : IPC_BACKEND_NONE;
+        info->capacity = -1;
+        info->out_queued = -1;
+        info->in_queued = -1;
+        return 0;
+    }
+
+    info->backend = info->writable || info->readable ? IPC_BACKEND_PIPE : IPC_BACKEND_NONE;
+    const Pipe *out = &ipc->pipes[ipc->id][peer];
+    const Pipe *in = &ipc->pipes[peer][ipc->id];
+    info->capacity = out->write_fd >= 0 ? pipe_set_capacity(out->write_fd, 0) : 0;
+    if (out->bulk_write_fd >= 0) {
+        info->capacity += pipe_set_capacity(out->bulk_write_fd, 0);
+    }
+    info->out_queued = pipe_queued(out->write_fd) + pipe_queued(out->bulk_write_fd);
+    info->in_queued = pipe_queued(in->read_fd) + pipe_queued(in->bulk_read_fd);
+    return 0;
+}
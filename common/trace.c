@@ -0,0 +1,74 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+__thread TraceBuffer *trace_buffer = NULL;
+
+void trace_init(local_id id) {
+    const char *dir = getenv("IPC_TRACE");
+    if (!dir) {
+        return;
+    }
+
+    TraceBuffer *buf = trace_buffer;
+    if (!buf) {
+        buf = malloc(sizeof(TraceBuffer));
+        TraceEvent *events = malloc(TRACE_MAX_EVENTS * sizeof(TraceEvent));
+        if (!buf || !events) {
+            perror("malloc trace buffer failed");
+            exit(1);
+        }
+        buf->events = events;
+    }
+    buf->count = 0;
+    buf->dropped = 0;
+    buf->id = id;
+
+    // Калибровка TSC дорогая - делаем ее здесь, а не в маркере
+    clock_raw_init();
+    trace_buffer = buf;
+}
+
+int trace_flush(void) {
+    TraceBuffer *buf = trace_buffer;
+    if (!buf) {
+        return 0;
+    }
+    trace_buffer = NULL;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/trace_%d.json", getenv("IPC_TRACE"), buf->id);
+    FILE *file = fopen(path, "w");
+    int rc = file ? 0 : -1;
+
+    if (file) {
+        const char *who = buf->id == PARENT_ID ? "parent" : "process";
+        fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                      "\"args\":{\"name\":\"%s %d\"}}", buf->id, who, buf->id);
+        for (uint32_t k = 0; k < buf->count; k++) {
+            const TraceEvent *event = &buf->events[k];
+            uint64_t ts_ns = clock_raw_to_ns(event->ts);
+            // ts в микросекундах; дробная часть сохраняет наносекунды
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":0%s}",
+                    event->name, event->phase,
+                    (unsigned long long)(ts_ns / 1000), (unsigned long long)(ts_ns % 1000),
+                    buf->id, event->phase == 'i' ? ",\"s\":\"p\"" : "");
+        }
+        if (buf->dropped > 0) {
+            fprintf(file, ",\n{\"name\":\"trace_dropped\",\"ph\":\"C\",\"ts\":%llu,\"pid\":%d,"
+                          "\"args\":{\"events\":%u}}",
+                    (unsigned long long)(buf->count ? clock_raw_to_ns(buf->events[buf->count - 1].ts) / 1000 : 0),
+                    buf->id, buf->dropped);
+        }
+        fprintf(file, "\n]}\n");
+        if (fclose(file) != 0) {
+            rc = -1;
+        }
+    }
+
+    free(buf->events);
+    free(buf);
+    return rc;
+}
@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "wait_policy.h"
+#include "clock.h"
+#include <string.h>
+#include <unistd.h>
+
+
+enum {
+    WAIT_EWMA_SHIFT = 3  ///< вес нового наблюдения 1/8
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static uint64_t ewma(uint64_t avg, uint64_t sample) {
+    if (avg == 0) {
+        return sample;
+    }
+    return avg - (avg >> WAIT_EWMA_SHIFT) + (sample >> WAIT_EWMA_SHIFT);
+}
+
+void wait_policy_init(WaitPolicy *policy, uint32_t spin_limit) {
+    memset(policy, 0, sizeof(WaitPolicy));
+
+    // На одном ядре опрос только отнимает время у того, кто должен ответить
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        spin_limit = 0;
+    }
+    policy->spin_limit = spin_limit;
+    policy->spin_cap = spin_limit;
+}
+
+// Опрашиваем примерно вдвое дольше ожидаемого интервала: если сообщение
+// должно прийти за это время, засыпать невыгодно
+// Кроме того, бюджет ограничен spin_cap: промах опроса его уменьшает вдвое,
+// попадание удваивает, так что бесполезный опрос быстро сходит на нет
+static uint32_t spin_budget(const WaitPolicy *policy) {
+    if (policy->ewma_gap_ns == 0 || policy->spin_cost_ns == 0) {
+        return policy->spin_cap;
+    }
+
+    uint64_t budget = 2 * policy->ewma_gap_ns / policy->spin_cost_ns;
+    return budget < policy->spin_cap ? (uint32_t)budget : policy->spin_cap;
+}
+
+int wait_policy_wait(WaitPolicy *policy, WaitReadyFn ready, WaitBlockFn block,
+                     void *arg, int timeout_ms) {
+    uint32_t budget = policy->spin_limit ? spin_budget(policy) : 0;
+
+    if (budget > 0) {
+        uint64_t start = clock_now_ns();
+        uint32_t i = 0;
+        int hit = 0;
+
+        while (i < budget) {
+            i++;
+            if (ready(arg)) {
+                hit = 1;
+                break;
+            }
+            cpu_relax();
+        }
+
+        policy->spin_cost_ns = ewma(policy->spin_cost_ns, (clock_now_ns() - start) / i);
+        if (hit) {
+            policy->spin_hits++;
+            policy->spin_cap = policy->spin_cap * 2 < policy->spin_limit ?
+                               policy->spin_cap * 2 : policy->spin_limit;
+            return 1;
+        }
+        if (policy->spin_cap > 1) {
+            policy->spin_cap /= 2;
+        }
+    }
+
+    policy->blocks++;
+    return block(arg, timeout_ms);
+}
+
+void wait_policy_arrived(WaitPolicy *policy) {
+    uint64_t now = clock_now_ns();
+
+    if (policy->last_arrival_ns != 0) {
+        policy->ewma_gap_ns = ewma(policy->ewma_gap_ns, now - policy->last_arrival_ns);
+    }
+    policy->last_arrival_ns = now;
+}
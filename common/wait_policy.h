@@ -0,0 +1,49 @@
+#ifndef WAIT_POLICY_H
+#define WAIT_POLICY_H
+
+#include <stdint.h>
+
+// Ожидание входящих сообщений: сначала короткий опрос с pause, потом
+// блокировка в ядре. Длина опроса подстраивается под сглаженный интервал
+// между приходами сообщений: при частом обмене (пинг-понг TRANSFER -> ACK)
+// ответ ловится без засыпания, при редком процессор не жжется зря.
+// Транспорт задает две операции: проверку готовности без ожидания и
+// блокирующее ожидание - так политика подходит и каналам, и общей памяти.
+
+enum {
+    WAIT_DEFAULT_SPIN = 2000  ///< верхняя граница итераций опроса
+};
+
+/** @return не 0, если данные уже можно читать */
+typedef int (*WaitReadyFn)(void * arg);
+
+/** Блокирующее ожидание не дольше timeout_ms (-1 - без ограничения).
+ *
+ * @return > 0 готово, 0 таймаут, < 0 ошибка (errno как у poll())
+ */
+typedef int (*WaitBlockFn)(void * arg, int timeout_ms);
+
+typedef struct {
+    uint32_t spin_limit;       ///< 0 - сразу блокироваться
+    uint32_t spin_cap;         ///< текущий предел, подстраивается по попаданиям
+    uint64_t ewma_gap_ns;      ///< сглаженный интервал между приходами
+    uint64_t last_arrival_ns;
+    uint64_t spin_cost_ns;     ///< сглаженная цена одной итерации опроса
+    uint64_t spin_hits;        ///< сколько ожиданий закончилось на опросе
+    uint64_t blocks;           ///< сколько ушло в блокировку
+} WaitPolicy;
+
+void wait_policy_init(WaitPolicy * policy, uint32_t spin_limit);
+
+/** Дождаться готовности: опрос ready() до текущего бюджета, затем block().
+ *
+ * @return как у WaitBlockFn
+ */
+int wait_policy_wait(WaitPolicy * policy, WaitReadyFn ready, WaitBlockFn block,
+                     void * arg, int timeout_ms);
+
+/** Отметить приход сообщения - обновляет оценку интервала.
+ */
+void wait_policy_arrived(WaitPolicy * policy);
+
+#endif // WAIT_POLICY_H
@@ -11,50 +11,199 @@
  #include "ipc.h"
  #include "common.h"
  #include "pa2345.h"
+ #include "failure_detector.h"
+ #include "ipc_ext.h"
+ #include "wait_policy.h"
+ #include "ledger.h"
+ #include "codec.h"
+ #include "workload.h"
+ #include "transfer.h"
+ #include "trace.h"
+ #include "coroutine.h"
  #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/wait.h>
  
  // Структура для хранения состояния процесса
  typedef struct {
      local_id id;
      int pipe_fd[MAX_PROCESS_ID + 1][2]; // [from][to]
-     balance_t balance;
-     BalanceHistory balance_history;
      int max_id;
+     void *ipc;        // контекст из ipc_fork_nodes(): его получают send()/receive()
+     int accounts;     // число счетов; == max_id, если у каждого процесса один счет
+     Ledger ledger;    // шард счетов этого процесса
+     uint32_t transfer_seq;  // последний номер, присвоенный своему переводу
+     LedgerOutbox *outbox;   // свой у каждого узла: потоки одного процесса его не делят
+     pid_t pid;              // в режимах потоков и сопрограмм у всех узлов один pid
+     pid_t parent_pid;
  } ProcessData;
  
+ // Как запускаются узлы: IPC_MODE=processes (по умолчанию), threads или coroutines
+ typedef enum {
+     MODE_PROCESSES,
+     MODE_THREADS,
+     MODE_COROUTINES
+ } RunMode;
+ 
+ // Параметры запуска, общие для всех узлов; узлы их только читают
+ typedef struct {
+     RunMode mode;
+     int num_children;
+     int num_accounts;
+     const balance_t *balances;
+     long initial_total;
+     const WorkloadConfig *workload;   // NULL - переводы делает bank_robbery()
+ } NodeArgs;
+ 
+ // Все ли остальные процессы (включая родителя) еще живы
+ static int all_peers_alive(ProcessData *data) {
+     for (local_id i = 0; i <= data->max_id; i++) {
+         if (i != data->id && !peer_alive(data->ipc, i)) {
+             return 0;
+         }
+     }
+     return 1;
+ }
+ 
+ // Живы ли дочерние процессы, от которых еще не пришла история:
+ // отчитавшийся ребенок завершается, и его закрытый канал - не отказ
+ static int pending_children_alive(ProcessData *data, const uint8_t *reported) {
+     for (local_id i = 1; i <= data->max_id; i++) {
+         if (!reported[i] && !peer_alive(data->ipc, i)) {
+             return 0;
+         }
+     }
+     return 1;
+ }
 
  
- void transfer(void *parent_data, local_id src, local_id dst, balance_t amount) {
+ // Отправить пачку переводов владельцам счетов-источников и дождаться,
+ // пока каждый перевод не будет зачислен или отклонен
+ int transfer_batch(void *parent_data, const TransferOrder *orders, int count, TransferStatus *status) {
      ProcessData *data = (ProcessData *)parent_data;
+     LedgerOutbox *outbox = data->outbox;
      
-     // Создаем TransferOrder
-     TransferOrder order;
-     order.s_src = src;
-     order.s_dst = dst;
-     order.s_amount = amount;
-     // Создаем сообщение
-     Message msg;
-     msg.s_header.s_magic = MESSAGE_MAGIC;
-     msg.s_header.s_type = TRANSFER;
-     msg.s_header.s_payload_len = sizeof(TransferOrder);
-     msg.s_header.s_local_time = get_physical_time();
-     memcpy(msg.s_payload, &order, sizeof(TransferOrder));
+     // Шарду уходит одно сообщение, а в него помещается LEDGER_MAX_BATCH переводов:
+     // длинную пачку отправляем частями
+     if (count > LEDGER_MAX_BATCH) {
+         int rejected = 0;
+         for (int done = 0; done < count; done += LEDGER_MAX_BATCH) {
+             int part = count - done < LEDGER_MAX_BATCH ? count - done : LEDGER_MAX_BATCH;
+             int rc = transfer_batch(parent_data, orders + done, part, status ? status + done : NULL);
+             if (rc < 0) {
+                 for (int k = done + part; k < count && status; k++) {
+                     status[k] = TRANSFER_FAILED;
+                 }
+                 return -1;
+             }
+             rejected += rc;
+         }
+         return rejected;
+     }
      
-     // Отправляем сообщение процессу-источнику
-     send(data, src, &msg);
+     TRACE_SCOPE("transfer_batch");
      
-     // Ждем ACK от процесса-получателя
-     Message ack_msg;
-     while (1) {
-         if (receive(data, dst, &ack_msg) == 0) {
-             if (ack_msg.s_header.s_type == ACK) {
-                 break;
+     // Каждый перевод получает номер (id, seq): повторная отправка не применит его дважды.
+     // Номера пачки идут подряд, по номеру из NACK находится сам перевод
+     uint32_t first_seq = data->transfer_seq + 1;
+     ledger_outbox_reset(outbox);
+     for (int k = 0; k < count; k++) {
+         if (status) {
+             status[k] = TRANSFER_OK;
+         }
+         local_id owner = ledger_owner(data->accounts, data->max_id, orders[k].s_src);
+         outbox->orders[owner][outbox->count[owner]] = orders[k];
+         outbox->ids[owner][outbox->count[owner]].origin = data->id;
+         outbox->ids[owner][outbox->count[owner]++].seq = ++data->transfer_seq;
+     }
+     
+     // Переводы, которые не удалось отправить, ответа не получат: сразу считаем
+     // их неудавшимися, но ждем ответов на отправленные, чтобы они не достались
+     // следующей пачке
+     int settled = 0;
+     int failed = 0;
+     for (local_id owner = 1; owner <= data->max_id; owner++) {
+         if (outbox->count[owner] == 0) {
+             continue;
+         }
+         Message msg;
+         TransferId *ids;
+         TransferOrder *out = encode_transfer(&msg, outbox->count[owner], get_physical_time(), &ids);
+         memcpy(out, outbox->orders[owner], outbox->count[owner] * sizeof(TransferOrder));
+         memcpy(ids, outbox->ids[owner], outbox->count[owner] * sizeof(TransferId));
+         if (send(data->ipc, owner, &msg) != 0) {
+             for (int k = 0; k < outbox->count[owner] && status; k++) {
+                 status[outbox->ids[owner][k].seq - first_seq] = TRANSFER_FAILED;
+             }
+             settled += outbox->count[owner];
+             failed = 1;
+         }
+     }
+     if (failed) {
+         fprintf(stderr, "transfer batch: send to a shard failed\n");
+     }
+     
+     // ACK несет BatchAck: сколько шард зачислил, отсеял как повтор и отложил;
+     // отклоненные приходят отдельно в TRANSFER_NACK
+     int rejected = 0;
+     int held = 0;
+     while (settled < count) {
+         // Все неурегулированные переводы отложены, и зачислений в пути нет -
+         // деньги им прийти неоткуда, отменяем (шарды ответят NACK)
+         if (held > 0 && held == count - settled) {
+             Message cancel;
+             TransferId *no_ids;
+             encode_transfer(&cancel, 0, get_physical_time(), &no_ids);
+             send_multicast(data->ipc, &cancel);
+             held = 0;
+         }
+         
+         Message reply;
+         if (receive_any(data->ipc, &reply) == 0) {
+             BatchAck ack;
+             const TransferId *ids;
+             int nacked;
+             if (decode_batch_ack(&reply, &ack) == 0) {
+                 settled += ack.applied + ack.duplicate;
+                 held += ack.held - ack.released;
+             } else if ((nacked = decode_nack(&reply, &ids)) >= 0) {
+                 settled += nacked;
+                 rejected += nacked;
+                 for (int k = 0; k < nacked && status; k++) {
+                     uint32_t index = ids[k].seq - first_seq;
+                     if (ids[k].origin == data->id && index < (uint32_t)count) {
+                         status[index] = TRANSFER_REJECTED;
+                     }
+                 }
              }
+         } else if (!all_peers_alive(data)) {
+             // Участник перевода умер - ACK уже не придет
+             fprintf(stderr, "transfer batch aborted: %d of %d settled, peer is not alive\n",
+                     settled, count);
+             for (int k = 0; k < count && status; k++) {
+                 status[k] = TRANSFER_FAILED;
+             }
+             return -1;
          }
      }
+     return failed ? -1 : rejected;
+ }
+ 
+ TransferStatus transfer_checked(void *parent_data, local_id src, local_id dst, balance_t amount) {
+     TransferOrder order;
+     order.s_src = src;
+     order.s_dst = dst;
+     order.s_amount = amount;
+     
+     TransferStatus status;
+     transfer_batch(parent_data, &order, 1, &status);
+     return status;
+ }
+ 
+ void transfer(void *parent_data, local_id src, local_id dst, balance_t amount) {
+     transfer_checked(parent_data, src, dst, amount);
  }
 
  void bank_robbery(void * parent_data, local_id max_id)
@@ -68,117 +217,192 @@
 }
 
  
- // Функция для обработки сообщений в дочерних процессах
- void child_process(ProcessData *data, balance_t initial_balance) {
-     data->balance = initial_balance;
+ // Пачка переводов: применяем за один проход, кредиты чужих счетов
+ // пересылаем их владельцам сообщениями до LEDGER_MAX_BATCH переводов.
+ // Пустая пачка - отмена отложенных
+ static void handle_transfer(ProcessData *data, Message *msg) {
+     LedgerOutbox *outbox = data->outbox;
+     const TransferOrder *orders;
+     const TransferId *ids;
+     int count = decode_transfer(msg, &orders, &ids);
+     timestamp_t now = get_physical_time();
      
-     // Инициализируем историю баланса
-     data->balance_history.s_id = data->id;
-     data->balance_history.s_history_len = 0;
+     if (count < 0) {
+         return;
+     }
      
-     // Записываем начальное состояние
-     BalanceState initial_state;
-     initial_state.s_balance = initial_balance;
-     initial_state.s_time = get_physical_time();
-     initial_state.s_balance_pending_in = 0;
+     ledger_outbox_reset(outbox);
+     BatchAck ack = { 0, 0, 0, 0 };
+     if (count == 0) {
+         ledger_cancel_pending(&data->ledger, outbox);
+     } else {
+         ack = ledger_apply(&data->ledger, orders, ids, count, data->accounts, data->max_id, now, outbox);
+     }
      
-     data->balance_history.s_history[0] = initial_state;
-     data->balance_history.s_history_len = 1;
+     // Отказ уходит родителю первым: ему незачем ждать пересылок
+     if (outbox->rejected_count > 0) {
+         Message nack;
+         TransferId *rejected = encode_nack(&nack, outbox->rejected_count, now);
+         memcpy(rejected, outbox->rejected, outbox->rejected_count * sizeof(TransferId));
+         send(data->ipc, PARENT_ID, &nack);
+     }
      
-     // Логируем старт
-     printf(log_started_fmt, 
-            get_physical_time(), data->id, getpid(), getppid(), initial_balance);
+     // Одиночный перевод логируем как раньше; повтор уже залогирован
+     if (count == 1 && ack.duplicate == 0 && ack.held == 0) {
+         if (ledger_owns(&data->ledger, orders[0].s_src) && outbox->rejected_count == 0) {
+             printf(log_transfer_out_fmt, now, orders[0].s_src, orders[0].s_amount, orders[0].s_dst);
+         }
+         if (ledger_owns(&data->ledger, orders[0].s_dst) && ack.applied == 1) {
+             printf(log_transfer_in_fmt, now, orders[0].s_dst, orders[0].s_amount, orders[0].s_src);
+         }
+     }
      
-     // Отправляем STARTED родителю
+     // Освобожденные отложенные идут сверх самой пачки и в одно сообщение могут не влезть
+     for (local_id owner = 1; owner <= data->max_id; owner++) {
+         for (int sent = 0; sent < outbox->count[owner]; sent += LEDGER_MAX_BATCH) {
+             int part = outbox->count[owner] - sent < LEDGER_MAX_BATCH ? outbox->count[owner] - sent : LEDGER_MAX_BATCH;
+             Message forward;
+             TransferId *forward_ids;
+             TransferOrder *out = encode_transfer(&forward, part, now, &forward_ids);
+             memcpy(out, &outbox->orders[owner][sent], part * sizeof(TransferOrder));
+             memcpy(forward_ids, &outbox->ids[owner][sent], part * sizeof(TransferId));
+             send(data->ipc, owner, &forward);
+         }
+     }
+     
+     if (ack.applied == 0 && ack.duplicate == 0 && ack.held == 0 && ack.released == 0) {
+         return;
+     }
+     
+     // Отчитываемся родителю за свою часть пачки
+     Message ack_msg;
+     *encode_batch_ack(&ack_msg, now) = ack;
+     
+     send(data->ipc, PARENT_ID, &ack_msg);
+ }
+ 
+ // История для родителя: при одном счете на процесс - история этого счета,
+ // при шардировании - сумма балансов шарда после каждого изменения
+ static void shard_history(ProcessData *data, BalanceHistory *history) {
+     Ledger *ledger = &data->ledger;
+     
+     if (ledger->count == 1) {
+         ledger_history(ledger, ledger->first, history);
+         history->s_id = data->id;
+         return;
+     }
+     
+     balance_t last[LEDGER_MAX_ACCOUNTS + 1] = { 0 };
+     balance_t total = 0;
+     int len = 0;
+     
+     history->s_id = data->id;
+     for (size_t k = 0; k < ledger->hist_len; k++) {
+         local_id account = ledger->hist_account[k];
+         total += ledger->hist_balance[k] - last[account];
+         last[account] = ledger->hist_balance[k];
+         
+         // Начальные балансы счетов сливаются в одно состояние
+         if (k + 1 < (size_t)ledger->count) {
+             continue;
+         }
+         if (len > 0 && history->s_history[len - 1].s_time == ledger->hist_time[k]) {
+             len--;
+         } else if (len == MAX_T) {
+             // Места нет: итоговый баланс важнее промежуточного
+             len--;
+         }
+         history->s_history[len].s_balance = total;
+         history->s_history[len].s_time = ledger->hist_time[k];
+         history->s_history[len].s_balance_pending_in = 0;
+         len++;
+     }
+     history->s_history_len = (uint8_t)len;
+ }
+ 
+ // Функция для обработки сообщений в дочерних процессах
+ void child_process(ProcessData *data, const balance_t *initial_balances) {
+     local_id first;
+     int count;
+     trace_begin("startup");
+     ledger_shard(data->accounts, data->max_id, data->id, &first, &count);
+     ledger_init(&data->ledger, first, count, initial_balances + first - 1, get_physical_time());
+     
+     // С LEDGER_JOURNAL_DIR шард переживает перезапуск: состояние берется из журнала
+     const char *journal_dir = getenv("LEDGER_JOURNAL_DIR");
+     if (journal_dir) {
+         char path[256];
+         snprintf(path, sizeof(path), "%s/ledger_%d.jrn", journal_dir, data->id);
+         int restored = ledger_attach_journal(&data->ledger, path, get_physical_time());
+         if (restored == 1) {
+             fprintf(stderr, "process %d: shard restored from %s\n", data->id, path);
+         } else if (restored < 0) {
+             fprintf(stderr, "process %d: running without journal %s\n", data->id, path);
+         }
+     }
+     
+     // С LEDGER_PENDING необеспеченный перевод ждет денег, а не отклоняется сразу
+     const char *pending = getenv("LEDGER_PENDING");
+     if (pending) {
+         ledger_set_pending(&data->ledger, atoi(pending));
+     }
+     
+     // Логируем старт; та же строка уходит в STARTED
      Message started_msg;
-     started_msg.s_header.s_magic = MESSAGE_MAGIC;
-     started_msg.s_header.s_type = STARTED;
-     started_msg.s_header.s_payload_len = 0;
-     started_msg.s_header.s_local_time = get_physical_time();
+     encode_string(&started_msg, STARTED, get_physical_time(), log_started_fmt,
+                   get_physical_time(), data->id, data->pid, data->parent_pid, ledger_total(&data->ledger));
+     fputs(started_msg.s_payload, stdout);
      
-     send_multicast(data, &started_msg);
+     send_multicast(data->ipc, &started_msg);
+     trace_end("startup");
      
      // Основной цикл обработки сообщений
+     int done_count = 0;      // DONE соседа может прийти раньше нашего STOP
      int done_received = 0;
      while (!done_received) {
          Message msg;
-         if (receive_any(data, &msg) == 0) {
+         if (receive_any(data->ipc, &msg) == 0) {
              switch (msg.s_header.s_type) {
+                 case DONE: {
+                     done_count++;
+                     break;
+                 }
+                 
                  case TRANSFER: {
-                     TransferOrder *order = (TransferOrder *)msg.s_payload;
-                     
-                     if (data->id == order->s_src) {
-                         // Мы - источник перевода
-                         if (data->balance >= order->s_amount) {
-                             data->balance -= order->s_amount;
-                             
-                             // Логируем отправку
-                             printf(log_transfer_out_fmt,
-                                    get_physical_time(), data->id, order->s_amount, order->s_dst);
-                             
-                             // Пересылаем сообщение получателю
-                             send(data, order->s_dst, &msg);
-                         }
-                     } else if (data->id == order->s_dst) {
-                         // Мы - получатель перевода
-                         data->balance += order->s_amount;
-                         
-                         // Логируем получение
-                         printf(log_transfer_in_fmt,
-                                get_physical_time(), data->id, order->s_amount, order->s_src);
-                         
-                         // Отправляем ACK родителю
-                         Message ack_msg;
-                         ack_msg.s_header.s_magic = MESSAGE_MAGIC;
-                         ack_msg.s_header.s_type = ACK;
-                         ack_msg.s_header.s_payload_len = 0;
-                         ack_msg.s_header.s_local_time = get_physical_time();
-                         
-                         send(data, PARENT_ID, &ack_msg);
-                     }
-                     
-                     // Обновляем историю баланса
-                     BalanceState new_state;
-                     new_state.s_balance = data->balance;
-                     new_state.s_time = get_physical_time();
-                     new_state.s_balance_pending_in = 0;
-                     
-                     data->balance_history.s_history[data->balance_history.s_history_len] = new_state;
-                     data->balance_history.s_history_len++;
-                     
+                     TRACE_SCOPE("handle_transfer");
+                     handle_transfer(data, &msg);
                      break;
                  }
                  
                  case STOP: {
-                     // Отправляем DONE родителю
+                     // Отправляем DONE всем: родителю и остальным дочерним
                      Message done_msg;
-                     done_msg.s_header.s_magic = MESSAGE_MAGIC;
-                     done_msg.s_header.s_type = DONE;
-                     done_msg.s_header.s_payload_len = 0;
-                     done_msg.s_header.s_local_time = get_physical_time();
+                     encode_empty(&done_msg, DONE, get_physical_time());
                      
-                     send(data, PARENT_ID, &done_msg);
+                     send_multicast(data->ipc, &done_msg);
                      
                      // Ждем DONE от всех процессов
-                     int done_count = 0;
+                     trace_begin("wait DONE");
                      while (done_count < data->max_id - 1) {
                          Message temp_msg;
-                         if (receive_any(data, &temp_msg) == 0) {
+                         if (receive_any(data->ipc, &temp_msg) == 0) {
                              if (temp_msg.s_header.s_type == DONE) {
                                  done_count++;
                              }
+                         } else if (!all_peers_alive(data)) {
+                             break;
                          }
                      }
+                     trace_end("wait DONE");
                      
-                     // Отправляем историю баланса родителю
-                     Message history_msg;
-                     history_msg.s_header.s_magic = MESSAGE_MAGIC;
-                     history_msg.s_header.s_type = BALANCE_HISTORY;
-                     history_msg.s_header.s_payload_len = sizeof(BalanceHistory);
-                     history_msg.s_header.s_local_time = get_physical_time();
+                     // Отправляем историю баланса родителю: varint вместо sizeof(BalanceHistory)
+                     TRACE_SCOPE("send history");
+                     BalanceHistory balance_history;
+                     shard_history(data, &balance_history);
                      
-                     memcpy(history_msg.s_payload, &data->balance_history, sizeof(BalanceHistory));
-                     send(data, PARENT_ID, &history_msg);
+                     Message history_msg;
+                     encode_history(&history_msg, &balance_history, get_physical_time());
+                     send(data->ipc, PARENT_ID, &history_msg);
                      
                      done_received = 1;
                      break;
@@ -188,83 +412,227 @@
      }
      
      // Логируем завершение
-     printf(log_done_fmt, get_physical_time(), data->id, data->balance);
+     printf(log_done_fmt, get_physical_time(), data->id, ledger_total(&data->ledger));
+     ledger_free(&data->ledger);
+     trace_flush();
+ }
+ 
+ // Родитель: раздает переводы, затем собирает и печатает истории
+ static int parent_process(ProcessData *data, const NodeArgs *args) {
+     int num_children = args->num_children;
+     
+     // Ждем STARTED от всех дочерних процессов
+     int started_count = 0;
+     Message msg;
+     trace_begin("wait STARTED");
+     while (started_count < num_children) {
+         if (receive_any(data->ipc, &msg) == 0) {
+             if (msg.s_header.s_type == STARTED) {
+                 started_count++;
+             }
+         } else if (!all_peers_alive(data)) {
+             fprintf(stderr, "Not all children have STARTED\n");
+             trace_flush();
+             return 1;
+         }
+     }
+     trace_end("wait STARTED");
+     
+     // Выполняем переводы
+     WorkloadReport report;
+     trace_begin("transfers");
+     if (args->workload) {
+         if (workload_run(data, args->num_accounts, args->workload, &report) != 0) {
+             fprintf(stderr, "workload aborted after %d transfers\n", report.transfers);
+         }
+     } else {
+         bank_robbery(data, args->num_accounts);
+     }
+     trace_end("transfers");
+     
+     // Отправляем STOP всем дочерним процессам
+     Message stop_msg;
+     encode_empty(&stop_msg, STOP, get_physical_time());
+     
+     send_multicast(data->ipc, &stop_msg);
+     
+     // Собираем истории балансов
+     AllHistory all_history;
+     all_history.s_history_len = num_children;
+     
+     int history_count = 0;
+     uint8_t reported[MAX_PROCESS_ID + 1] = { 0 };
+     trace_begin("collect histories");
+     while (history_count < num_children) {
+         Message history_msg;
+         if (receive_any(data->ipc, &history_msg) == 0) {
+             BalanceHistory *history = &all_history.s_history[history_count];
+             if (decode_history(&history_msg, history) == 0 &&
+                 history->s_id > 0 && history->s_id <= num_children) {
+                 reported[history->s_id] = 1;
+                 history_count++;
+             }
+         } else if (!pending_children_alive(data, reported)) {
+             // Печатаем то, что успели собрать
+             all_history.s_history_len = history_count;
+             break;
+         }
+     }
+     trace_end("collect histories");
+     trace_flush();
+     
+     // Нагрузка длится дольше MAX_T тиков, а print_history() больше не вмещает:
+     // вместо истории печатаем отчет нагрузки
+     if (args->workload) {
+         workload_print_report(stderr, &report);
+         if (all_history.s_history_len == num_children &&
+             !workload_conserved(&all_history, args->initial_total)) {
+             fprintf(stderr, "workload: money is not conserved\n");
+             return 1;
+         }
+         return 0;
+     }
+     
+     // Выводим историю
+     print_history(&all_history);
+     return 0;
+ }
+ 
+ // Тело узла в любом режиме (ThreadEntry): self - его IPC-контекст
+ static int run_node(void *self, local_id id, void *arg) {
+     const NodeArgs *args = (const NodeArgs *)arg;
+     
+     ProcessData data;
+     data.id = id;
+     data.max_id = args->num_children;
+     data.accounts = args->num_accounts;
+     data.ipc = self;
+     data.transfer_seq = 0;
+     data.pid = getpid();
+     data.parent_pid = args->mode == MODE_PROCESSES ? getppid() : getpid();
+     data.outbox = malloc(sizeof(LedgerOutbox));
+     if (!data.outbox) {
+         perror("malloc outbox failed");
+         exit(1);
+     }
+     
+     // Буфер трассировки привязан к потоку, а сопрограммы переходят между потоками.
+     // Процессы заводят буфер в main(): родитель - еще до fork()
+     if (args->mode == MODE_THREADS) {
+         trace_init(id);
+     }
+     
+     // Ожидания STARTED/ACK/DONE не должны зависать на умершем узле
+     failure_detector_configure(self, FD_DEFAULT_TIMEOUT_MS, FD_DEFAULT_HEARTBEAT_MS);
+     
+     // TRANSFER -> ACK идет пинг-понгом: ответ ловим опросом, не засыпая в ядре
+     ipc_set_wait_policy(self, WAIT_DEFAULT_SPIN);
+     
+     // Истории балансов дети шлют родителю разом при STOP - шлем их сжатыми.
+     // Настройка контекста своя у каждого узла, поэтому ее делает сам узел
+     ipc_set_compression(self, IPC_COMPRESS_DEFAULT_MIN);
+     
+     int rc = 0;
+     if (id == PARENT_ID) {
+         rc = parent_process(&data, args);
+     } else {
+         child_process(&data, args->balances);
+     }
+     
+     free(data.outbox);
+     return rc;
  }
  
  int main(int argc, char * argv[])
 {
     if (argc < 4) {
-        fprintf(stderr, "Usage: %s -p N balance1 balance2 ... balanceN\n", argv[0]);
+        fprintf(stderr, "Usage: %s -p N balance1 balance2 ... balanceM (M >= N)\n", argv[0]);
         return 1;
     }
     
+    // Балансов может быть больше, чем процессов: тогда счета делятся на шарды
     int num_children = atoi(argv[2]);
-    if (argc != 3 + num_children) {
+    int num_accounts = argc - 3;
+    if (num_accounts < num_children || num_accounts > LEDGER_MAX_ACCOUNTS) {
         fprintf(stderr, "Invalid number of balance arguments\n");
         return 1;
     }
     
-    // Инициализация структур данных
-    ProcessData parent_data;
-    parent_data.id = PARENT_ID;
-    parent_data.max_id = num_children;
+    balance_t balances[LEDGER_MAX_ACCOUNTS];
+    long initial_total = 0;     // balance_t - int16, сумма счетов в него не влезает
+    for (int i = 0; i < num_accounts; i++) {
+        balances[i] = atoi(argv[3 + i]);
+        initial_total += balances[i];
+    }
     
-    // Создание pipe'ов и дочерних процессов
-    // ... (код из первой лабораторной работы)
+    // С WORKLOAD вместо bank_robbery() идет случайная нагрузка (workload.h)
+    const char *workload_spec = getenv("WORKLOAD");
+    WorkloadConfig workload;
+    if (workload_spec && workload_parse(workload_spec, &workload) != 0) {
+        fprintf(stderr, "Invalid WORKLOAD: %s\n", workload_spec);
+        return 1;
+    }
     
-    // Родительский процесс
-    if (getpid() == getppid()) {
-        // Ждем STARTED от всех дочерних процессов
-        int started_count = 0;
-        Message msg;
-        while (started_count < num_children) {
-            if (receive_any(&parent_data, &msg) == 0) {
-                if (msg.s_header.s_type == STARTED) {
-                    started_count++;
-                }
-            }
-        }
-        
-        // Выполняем переводы
-        bank_robbery(&parent_data, num_children);
-        
-        // Отправляем STOP всем дочерним процессам
-        Message stop_msg;
-        stop_msg.s_header.s_magic = MESSAGE_MAGIC;
-        stop_msg.s_header.s_type = STOP;
-        stop_msg.s_header.s_payload_len = 0;
-        stop_msg.s_header.s_local_time = get_physical_time();
-        
-        send_multicast(&parent_data, &stop_msg);
-        
-        // Собираем истории балансов
-        AllHistory all_history;
-        all_history.s_history_len = num_children;
-        
-        int history_count = 0;
-        while (history_count < num_children) {
-            Message history_msg;
-            if (receive_any(&parent_data, &history_msg) == 0) {
-                if (history_msg.s_header.s_type == BALANCE_HISTORY) {
-                    BalanceHistory *bh = (BalanceHistory *)history_msg.s_payload;
-                    all_history.s_history[history_count] = *bh;
-                    history_count++;
-                }
-            }
-        }
-        
-        // Выводим историю
-        print_history(&all_history);
-        
-        // Ждем завершения дочерних процессов
-        // ... (код из первой лабораторной работы)
+    // Шарды пересылают кредиты друг другу и рассылают DONE всем - ретрансляции нет
+    if (!ipc_topology_complete(num_children + 1)) {
+        fprintf(stderr, "Shards need channels between all processes, check IPC_TOPOLOGY\n");
+        return 1;
+    }
+    
+    NodeArgs args;
+    args.num_children = num_children;
+    args.num_accounts = num_accounts;
+    args.balances = balances;
+    args.initial_total = initial_total;
+    args.workload = workload_spec ? &workload : NULL;
+    
+    const char *mode = getenv("IPC_MODE");
+    if (!mode || strcmp(mode, "processes") == 0) {
+        args.mode = MODE_PROCESSES;
+    } else if (strcmp(mode, "threads") == 0) {
+        args.mode = MODE_THREADS;
+    } else if (strcmp(mode, "coroutines") == 0) {
+        args.mode = MODE_COROUTINES;
+    } else {
+        fprintf(stderr, "Invalid IPC_MODE: %s\n", mode);
+        return 1;
+    }
+    
+    // Узлы - потоки или сопрограммы этого процесса, каналы между ними в памяти
+    if (args.mode == MODE_THREADS) {
+        return ipc_run_threads(num_children + 1, run_node, &args) == 0 ? 0 : 1;
     }
-    // Дочерние процессы
-    else {
-        local_id child_id = parent_data.id;
-        balance_t initial_balance = atoi(argv[3 + child_id - 1]);
-        child_process(&parent_data, initial_balance);
+    if (args.mode == MODE_COROUTINES) {
+        // IPC_WORKERS - число потоков под сопрограммы, по умолчанию по числу CPU
+        const char *workers = getenv("IPC_WORKERS");
+        return ipc_run_coroutines(num_children + 1, workers ? atoi(workers) : 0, run_node, &args) == 0 ? 0 : 1;
+    }
+    
+    // Создание pipe'ов и дочерних процессов. Запуск тоже попадает в трассу родителя
+    trace_init(PARENT_ID);
+    trace_begin("fork nodes");
+    local_id id = PARENT_ID;
+    void *ipc = ipc_fork_nodes(num_children + 1, &id);
+    if (!ipc) {
+        fprintf(stderr, "Failed to start processes\n");
+        trace_flush();
+        return 1;
+    }
+    if (id == PARENT_ID) {
+        trace_end("fork nodes");
+    } else {
+        // Ребенку достались события родителя - начинаем свою трассу
+        trace_init(id);
+    }
+    
+    int rc = run_node(ipc, id, &args);
+    ipc_close(ipc);
+    
+    // Ждем завершения дочерних процессов; после сбоя они могут не дождаться STOP
+    if (id == PARENT_ID && rc == 0) {
+        while (wait(NULL) > 0) {
+        }
     }
     
-    return 0;
+    return rc;
 }
@@ -0,0 +1,104 @@
+#include "codec.h"
+#include <stdio.h>
+
+
+int encode_string(Message *msg, MessageType type, timestamp_t time, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    // '\0' остается за концом строки в payload, но в длину не входит
+    int len = vsnprintf(msg->s_payload, MAX_PAYLOAD_LEN, format, args);
+    va_end(args);
+
+    if (len < 0 || len >= MAX_PAYLOAD_LEN) {
+        return -1;
+    }
+    codec_header(msg, type, (uint16_t)len, time);
+    return 0;
+}
+
+static uint8_t *put_varint(uint8_t *pos, int32_t value) {
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    while (zigzag >= 0x80) {
+        *pos++ = (uint8_t)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    *pos++ = (uint8_t)zigzag;
+    return pos;
+}
+
+static const uint8_t *get_varint(const uint8_t *pos, const uint8_t *end, int32_t *value) {
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 32 && pos < end; shift += 7) {
+        uint8_t byte = *pos++;
+        zigzag |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+void encode_history(Message *msg, const BalanceHistory *history, timestamp_t time) {
+    uint8_t *start = (uint8_t *)msg->s_payload;
+    uint8_t *pos = start;
+
+    *pos++ = HISTORY_VARINT_MARK;
+    *pos++ = (uint8_t)history->s_id;
+    *pos++ = history->s_history_len;
+
+    BalanceState prev = { 0, 0, 0 };
+    for (int i = 0; i < history->s_history_len; i++) {
+        const BalanceState *state = &history->s_history[i];
+        pos = put_varint(pos, state->s_balance - prev.s_balance);
+        pos = put_varint(pos, state->s_time - prev.s_time);
+        pos = put_varint(pos, state->s_balance_pending_in - prev.s_balance_pending_in);
+        prev = *state;
+    }
+
+    codec_header(msg, BALANCE_HISTORY, (uint16_t)(pos - start), time);
+}
+
+int decode_history(const Message *msg, BalanceHistory *history) {
+    uint16_t len = msg->s_header.s_payload_len;
+    const uint8_t *pos = (const uint8_t *)msg->s_payload;
+    const uint8_t *end = pos + len;
+
+    if (msg->s_header.s_type != BALANCE_HISTORY || len < 2) {
+        return -1;
+    }
+
+    // Обычная кодировка: ровно заголовок и s_history_len состояний
+    if (pos[0] != HISTORY_VARINT_MARK) {
+        uint8_t count = pos[1];
+        if (len != offsetof(BalanceHistory, s_history) + count * sizeof(BalanceState)) {
+            return -1;
+        }
+        memcpy(history, msg->s_payload, len);
+        return 0;
+    }
+
+    if (len < 3) {
+        return -1;
+    }
+    history->s_id = (local_id)pos[1];
+    history->s_history_len = pos[2];
+    pos += 3;
+
+    BalanceState prev = { 0, 0, 0 };
+    for (int i = 0; i < history->s_history_len; i++) {
+        int32_t balance, time, pending;
+        if (!(pos = get_varint(pos, end, &balance)) ||
+            !(pos = get_varint(pos, end, &time)) ||
+            !(pos = get_varint(pos, end, &pending))) {
+            return -1;
+        }
+        BalanceState *state = &history->s_history[i];
+        state->s_balance = (balance_t)(prev.s_balance + balance);
+        state->s_time = (timestamp_t)(prev.s_time + time);
+        state->s_balance_pending_in = (balance_t)(prev.s_balance_pending_in + pending);
+        prev = *state;
+    }
+
+    return pos == end ? 0 : -1;
+}
@@ -0,0 +1,122 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "banking.h"
+#include "ledger.h"
+#include <stdarg.h>
+#include <string.h>
+
+// Кодеки payload по MessageType. Кодировщик пишет прямо в s_payload
+// исходящего сообщения и сам выставляет заголовок и точную длину;
+// декодер проверяет тип и длину вместо приведения (T *)msg.s_payload.
+// Размеры проверяются при компиляции.
+
+#define CODEC_STATIC_ASSERT(cond, name) typedef char codec_assert_##name[(cond) ? 1 : -1]
+
+enum {
+    /// Первый байт BALANCE_HISTORY в varint-кодировке. В обычной там s_id >= 0
+    HISTORY_VARINT_MARK = 0x80,
+    /// Худший случай varint-истории: метка, s_id, длина и по 3 varint на состояние
+    HISTORY_VARINT_MAX = 3 + MAX_T * 3 * 3
+};
+
+CODEC_STATIC_ASSERT(sizeof(TransferOrder) == 4, transfer_order_packed);
+CODEC_STATIC_ASSERT(sizeof(TransferId) == 5, transfer_id_packed);
+CODEC_STATIC_ASSERT(LEDGER_MAX_BATCH * (sizeof(TransferOrder) + sizeof(TransferId)) <= MAX_EXT_PAYLOAD_LEN,
+                    transfer_batch_fits);
+CODEC_STATIC_ASSERT(LEDGER_MAX_OUTBOX * sizeof(TransferId) <= MAX_EXT_PAYLOAD_LEN, nack_fits);
+CODEC_STATIC_ASSERT(sizeof(BalanceHistory) <= MAX_PAYLOAD_LEN, balance_history_fits);
+CODEC_STATIC_ASSERT((int)HISTORY_VARINT_MAX <= (int)MAX_PAYLOAD_LEN, varint_history_fits);
+
+static inline void codec_header(Message *msg, MessageType type, uint16_t len, timestamp_t time) {
+    msg->s_header.s_magic = MESSAGE_MAGIC;
+    msg->s_header.s_type = type;
+    msg->s_header.s_payload_len = len;
+    msg->s_header.s_local_time = time;
+}
+
+// Сообщения без содержимого: STOP, DONE и т.п.
+static inline void encode_empty(Message *msg, MessageType type, timestamp_t time) {
+    codec_header(msg, type, 0, time);
+}
+
+// Сообщения с фиксированной структурой. encode_<name>() возвращает указатель
+// на место в payload, куда заполнять структуру; decode_<name>() копирует ее,
+// если тип и длина совпали
+#define CODEC_FIXED(name, type, payload_t)                                             \
+    CODEC_STATIC_ASSERT(sizeof(payload_t) <= MAX_PAYLOAD_LEN, name##_fits);            \
+    static inline payload_t *encode_##name(Message *msg, timestamp_t time) {           \
+        codec_header(msg, type, sizeof(payload_t), time);                              \
+        return (payload_t *)msg->s_payload;                                            \
+    }                                                                                  \
+    static inline int decode_##name(const Message *msg, payload_t *out) {              \
+        if (msg->s_header.s_type != type || msg->s_header.s_payload_len != sizeof(payload_t)) { \
+            return -1;                                                                 \
+        }                                                                              \
+        memcpy(out, msg->s_payload, sizeof(payload_t));                                \
+        return 0;                                                                      \
+    }
+
+enum {
+    /// Номера отклоненных переводов, TransferId[]. Перечисление MessageType
+    /// в ipc.h менять нельзя, поэтому тип берется сразу за BALANCE_HISTORY
+    TRANSFER_NACK = BALANCE_HISTORY + 1
+};
+
+CODEC_FIXED(batch_ack, ACK, BatchAck)
+
+// TRANSFER - count переводов столбцами: TransferOrder[count], затем TransferId[count].
+// Пустой TRANSFER отменяет отложенные переводы. Декодер отдает указатели в payload без копии
+enum {
+    TRANSFER_ENTRY_SIZE = sizeof(TransferOrder) + sizeof(TransferId)
+};
+
+static inline TransferOrder *encode_transfer(Message *msg, int count, timestamp_t time, TransferId **ids) {
+    codec_header(msg, TRANSFER, (uint16_t)(count * TRANSFER_ENTRY_SIZE), time);
+    *ids = (TransferId *)(msg->s_payload + count * sizeof(TransferOrder));
+    return (TransferOrder *)msg->s_payload;
+}
+
+static inline int decode_transfer(const Message *msg, const TransferOrder **orders, const TransferId **ids) {
+    uint16_t len = msg->s_header.s_payload_len;
+    if (msg->s_header.s_type != TRANSFER || len % TRANSFER_ENTRY_SIZE != 0) {
+        return -1;
+    }
+    int count = len / TRANSFER_ENTRY_SIZE;
+    *orders = (const TransferOrder *)msg->s_payload;
+    *ids = (const TransferId *)(msg->s_payload + count * sizeof(TransferOrder));
+    return count;
+}
+
+static inline TransferId *encode_nack(Message *msg, int count, timestamp_t time) {
+    codec_header(msg, (MessageType)TRANSFER_NACK, (uint16_t)(count * sizeof(TransferId)), time);
+    return (TransferId *)msg->s_payload;
+}
+
+static inline int decode_nack(const Message *msg, const TransferId **ids) {
+    uint16_t len = msg->s_header.s_payload_len;
+    if (msg->s_header.s_type != TRANSFER_NACK || len % sizeof(TransferId) != 0) {
+        return -1;
+    }
+    *ids = (const TransferId *)msg->s_payload;
+    return len / sizeof(TransferId);
+}
+
+/** Строка по формату прямо в payload, без завершающего '\0'.
+ *
+ * @return 0 on success, -1 если строка не помещается
+ */
+int encode_string(Message *msg, MessageType type, timestamp_t time, const char *format, ...);
+
+/** BALANCE_HISTORY в varint-кодировке: разности соседних состояний
+ * в zigzag-varint, обычно по байту на поле вместо 6 байт на состояние.
+ */
+void encode_history(Message *msg, const BalanceHistory *history, timestamp_t time);
+
+/** Принимает и varint-, и обычную кодировку (BalanceHistory как есть).
+ *
+ * @return 0 on success, -1 если payload поврежден или тип не тот
+ */
+int decode_history(const Message *msg, BalanceHistory *history);
+
+#endif // CODEC_H
@@ -0,0 +1,61 @@
+#include "dedup.h"
+#include <string.h>
+
+
+void dedup_init(DedupTable *table) {
+    memset(table, 0, sizeof(DedupTable));
+}
+
+static uint64_t *slot(DedupWindow *window, uint32_t seq, uint64_t *mask) {
+    uint32_t bit = seq % DEDUP_WINDOW;
+    *mask = 1ULL << (bit % 64);
+    return &window->seen[bit / 64];
+}
+
+int dedup_seen(const DedupTable *table, const TransferId *id) {
+    if (id->seq == 0 || id->origin < 0 || id->origin > MAX_PROCESS_ID) {
+        return 0;
+    }
+
+    const DedupWindow *window = &table->origin[id->origin];
+    if (id->seq > window->top || window->top - id->seq >= DEDUP_WINDOW) {
+        return 0;
+    }
+    uint32_t bit = id->seq % DEDUP_WINDOW;
+    return (window->seen[bit / 64] >> (bit % 64)) & 1;
+}
+
+int dedup_accept(DedupTable *table, const TransferId *id) {
+    if (id->seq == 0 || id->origin < 0 || id->origin > MAX_PROCESS_ID) {
+        return 1;
+    }
+
+    DedupWindow *window = &table->origin[id->origin];
+    uint64_t mask;
+
+    if (id->seq > window->top) {
+        // Окно сдвигается: биты номеров, выпавших из него, освобождаются под новые
+        uint32_t shift = id->seq - window->top;
+        if (shift >= DEDUP_WINDOW) {
+            memset(window->seen, 0, sizeof(window->seen));
+        } else {
+            for (uint32_t seq = window->top + 1; seq != id->seq; seq++) {
+                *slot(window, seq, &mask) &= ~mask;
+            }
+        }
+        window->top = id->seq;
+        *slot(window, id->seq, &mask) |= mask;
+        return 1;
+    }
+
+    if (window->top - id->seq >= DEDUP_WINDOW) {
+        return 0;
+    }
+
+    uint64_t *word = slot(window, id->seq, &mask);
+    if (*word & mask) {
+        return 0;
+    }
+    *word |= mask;
+    return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "ipc.h"
+#include <stdint.h>
+
+// Отсев повторно присланных переводов. Перевод помечается (origin, seq):
+// origin присвоил номер, seq растет с 1. На каждого origin хранится окно
+// из DEDUP_WINDOW последних номеров битовой картой, поэтому память
+// ограничена и не зависит от числа переводов. Номер старше окна считается
+// повтором: применить перевод дважды хуже, чем отклонить запоздавший.
+// С журналом шарда окно переживает перезапуск: принятые номера пишутся
+// в журнал, а окна целиком - в снимок контрольной точки.
+
+enum {
+    DEDUP_WINDOW = 1024  ///< номеров на источник; кратно 64
+};
+
+typedef struct {
+    uint32_t seq;        ///< 0 - перевод без номера, повторы не отсеиваются
+    local_id origin;
+} __attribute__((packed)) TransferId;
+
+typedef struct {
+    uint32_t top;                        ///< наибольший принятый номер, 0 - еще ни одного
+    uint64_t seen[DEDUP_WINDOW / 64];    ///< бит seq % DEDUP_WINDOW для seq из (top - DEDUP_WINDOW, top]
+} DedupWindow;
+
+typedef struct {
+    DedupWindow origin[MAX_PROCESS_ID + 1];
+} DedupTable;
+
+void dedup_init(DedupTable *table);
+
+/** Отметить перевод id как принятый.
+ *
+ * @return 1 если перевод новый, 0 если это повтор (или номер старше окна)
+ */
+int dedup_accept(DedupTable *table, const TransferId *id);
+
+/** Принят ли уже перевод id (номер в окне и отмечен).
+ */
+int dedup_seen(const DedupTable *table, const TransferId *id);
+
+#endif // DEDUP_H
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+
+#include "journal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+enum {
+    JOURNAL_VERSION = 1,
+    NO_CHECKPOINT = -1
+};
+
+struct JournalHeader {
+    char magic[4];           // "LJRN"
+    uint8_t version;
+    local_id first;
+    uint8_t count;
+    uint8_t incomplete;      // запись потеряна: восстанавливать из журнала нельзя
+    int64_t checkpoint;      // индекс первой записи снимка последней завершенной точки
+};
+
+static uint16_t record_check(const JournalRecord *r) {
+    return (uint16_t)(0xA5A5 ^ (r->kind << 8) ^ (uint8_t)r->account ^
+                      (uint16_t)r->balance ^ (uint16_t)(r->time << 3));
+}
+
+static int record_valid(const JournalRecord *r) {
+    return r->kind != JOURNAL_END && r->kind <= JOURNAL_ACCEPT && r->check == record_check(r);
+}
+
+static size_t map_size(size_t capacity) {
+    return sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+}
+
+static int journal_map(Journal *journal, size_t capacity) {
+    size_t len = map_size(capacity);
+    if (ftruncate(journal->fd, len) != 0) {
+        return -1;
+    }
+
+    char *map;
+    if (journal->map) {
+        map = mremap(journal->map, journal->map_len, len, MREMAP_MAYMOVE);
+    } else {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    journal->map = map;
+    journal->map_len = len;
+    journal->header = (JournalHeader *)map;
+    journal->records = (JournalRecord *)(map + sizeof(JournalHeader));
+    journal->capacity = capacity;
+    return 0;
+}
+
+int journal_open(Journal *journal, const char *path, local_id first, int count) {
+    memset(journal, 0, sizeof(Journal));
+
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (journal->fd < 0) {
+        perror("open journal failed");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(journal->fd, &st) != 0) {
+        perror("fstat journal failed");
+        close(journal->fd);
+        return -1;
+    }
+
+    size_t capacity = JOURNAL_INITIAL_RECORDS;
+    if ((size_t)st.st_size > sizeof(JournalHeader)) {
+        size_t existing = (st.st_size - sizeof(JournalHeader)) / sizeof(JournalRecord);
+        if (existing > capacity) {
+            capacity = existing;
+        }
+    }
+    int fresh = (size_t)st.st_size < sizeof(JournalHeader);
+
+    if (journal_map(journal, capacity) != 0) {
+        perror("mmap journal failed");
+        close(journal->fd);
+        return -1;
+    }
+
+    JournalHeader *header = journal->header;
+    if (fresh || memcmp(header->magic, "LJRN", 4) != 0) {
+        memset(journal->map, 0, journal->map_len);
+        memcpy(header->magic, "LJRN", 4);
+        header->version = JOURNAL_VERSION;
+        header->first = first;
+        header->count = (uint8_t)count;
+        header->incomplete = 0;
+        header->checkpoint = NO_CHECKPOINT;
+        return 0;
+    }
+
+    if (header->version != JOURNAL_VERSION || header->first != first || header->count != count) {
+        fprintf(stderr, "journal %s belongs to another shard\n", path);
+        journal_close(journal);
+        return -1;
+    }
+
+    if (header->incomplete) {
+        fprintf(stderr, "journal %s lost records, shard can't be restored from it\n", path);
+        journal_close(journal);
+        return -1;
+    }
+
+    if (header->checkpoint == NO_CHECKPOINT) {
+        return 0;
+    }
+
+    // Конец журнала - первая невалидная запись после контрольной точки
+    size_t len = (size_t)header->checkpoint;
+    while (len < journal->capacity && record_valid(&journal->records[len])) {
+        len++;
+    }
+    journal->len = len;
+    journal->since_checkpoint = len - header->checkpoint;
+    return 1;
+}
+
+void journal_close(Journal *journal) {
+    if (journal->map) {
+        msync(journal->map, journal->map_len, MS_SYNC);
+        munmap(journal->map, journal->map_len);
+    }
+    if (journal->fd >= 0) {
+        close(journal->fd);
+    }
+    memset(journal, 0, sizeof(Journal));
+    journal->fd = -1;
+}
+
+int journal_append(Journal *journal, JournalKind kind, local_id account,
+                   balance_t balance, timestamp_t time) {
+    // Рост удвоением: системные вызовы раз в capacity записей, а не на каждую
+    if (journal->len + 1 >= journal->capacity && journal_map(journal, journal->capacity * 2) != 0) {
+        perror("grow journal failed");
+        // Прежнее отображение осталось на месте - отмечаем потерю в нем
+        journal->header->incomplete = 1;
+        msync(journal->map, sizeof(JournalHeader), MS_SYNC);
+        return -1;
+    }
+
+    JournalRecord record;
+    record.kind = (uint8_t)kind;
+    record.account = account;
+    record.balance = balance;
+    record.time = time;
+    record.check = record_check(&record);
+
+    // Сначала граница следующей записи, потом поля, kind - последним: до его
+    // записи на этом месте стоит JOURNAL_END, и обрывок не примется за запись
+    JournalRecord *slot = &journal->records[journal->len];
+    journal->records[journal->len + 1].kind = JOURNAL_END;
+    slot->account = record.account;
+    slot->balance = record.balance;
+    slot->time = record.time;
+    slot->check = record.check;
+    __atomic_store_n(&slot->kind, record.kind, __ATOMIC_RELEASE);
+
+    journal->len++;
+    if (kind == JOURNAL_CHANGE) {
+        journal->since_checkpoint++;
+    }
+    return 0;
+}
+
+// Перенести снимок последней точки [checkpoint, len) в начало файла и
+// вернуть файлу начальный размер. На каждом шаге после падения журнал
+// читается правильно: пока заголовок указывает на старое место, копия в
+// начале не видна, а перед ее публикацией за ней уже стоит граница
+static void journal_compact(Journal *journal) {
+    size_t start = (size_t)journal->header->checkpoint;
+    size_t len = journal->len - start;
+    // Копия не должна задеть оригинал, а граница за ней - его первую запись
+    if (len >= start) {
+        return;
+    }
+
+    memcpy(journal->records, &journal->records[start], len * sizeof(JournalRecord));
+    journal->records[len].kind = JOURNAL_END;
+    __atomic_store_n(&journal->header->checkpoint, (int64_t)0, __ATOMIC_RELEASE);
+    journal->len = len;
+
+    if (journal->capacity > JOURNAL_INITIAL_RECORDS && len + 1 < JOURNAL_INITIAL_RECORDS) {
+        // Не вышло - журнал остается большим, но корректным
+        journal_map(journal, JOURNAL_INITIAL_RECORDS);
+    }
+}
+
+int journal_accept(Journal *journal, const TransferId *id) {
+    return journal_append(journal, JOURNAL_ACCEPT, id->origin, (balance_t)(id->seq & 0xFFFF),
+                          (timestamp_t)(id->seq >> 16));
+}
+
+TransferId journal_record_id(const JournalRecord *record) {
+    TransferId id;
+    id.origin = record->account;
+    id.seq = (uint16_t)record->balance | (uint32_t)(uint16_t)record->time << 16;
+    return id;
+}
+
+// Принятые номера окон по возрастанию: dedup_accept() в том же порядке
+// восстанавливает и верх окна, и битовую карту
+static int snapshot_dedup(Journal *journal, const DedupTable *dedup) {
+    for (int origin = 0; origin <= MAX_PROCESS_ID; origin++) {
+        uint32_t top = dedup->origin[origin].top;
+        if (top == 0) {
+            continue;
+        }
+        TransferId id;
+        id.origin = (local_id)origin;
+        for (id.seq = top >= DEDUP_WINDOW ? top - DEDUP_WINDOW + 1 : 1; id.seq <= top; id.seq++) {
+            if (dedup_seen(dedup, &id) && journal_accept(journal, &id) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int journal_checkpoint(Journal *journal, const balance_t *balances, const DedupTable *dedup,
+                       timestamp_t time) {
+    // journal_append() может переотобразить файл - header берем заново после записи
+    local_id first = journal->header->first;
+    int count = journal->header->count;
+    size_t start = journal->len;
+
+    for (int i = 0; i < count; i++) {
+        if (journal_append(journal, JOURNAL_SNAPSHOT, (local_id)(first + i), balances[i], time) != 0) {
+            return -1;
+        }
+    }
+    if (dedup && snapshot_dedup(journal, dedup) != 0) {
+        return -1;
+    }
+    if (journal_append(journal, JOURNAL_CHECKPOINT, first, 0, time) != 0) {
+        return -1;
+    }
+
+    // Точка становится действительной только после полного снимка
+    __atomic_store_n(&journal->header->checkpoint, (int64_t)start, __ATOMIC_RELEASE);
+    journal->since_checkpoint = 0;
+
+    journal_compact(journal);
+    msync(journal->map, journal->map_len, MS_ASYNC);
+    return 0;
+}
+
+size_t journal_tail(const Journal *journal, const JournalRecord **records) {
+    if (journal->header->checkpoint == NO_CHECKPOINT) {
+        *records = NULL;
+        return 0;
+    }
+    *records = &journal->records[journal->header->checkpoint];
+    return journal->len - (size_t)journal->header->checkpoint;
+}
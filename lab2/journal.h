@@ -0,0 +1,95 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "banking.h"
+#include "dedup.h"
+#include <stddef.h>
+
+// Журнал изменений балансов шарда: файл только на дозапись, отображенный
+// в память. Запись в журнал - это запись в память без системных вызовов;
+// содержимое переживает падение процесса (страницы принадлежат файлу),
+// msync(MS_ASYNC) вызывается только на контрольных точках.
+//
+// Контрольная точка - снимок всех балансов шарда. Восстановление начинается
+// с последней завершенной точки и проигрывает изменения после нее. Записи
+// до точки больше не нужны: снимок переносится в начало файла, и файл
+// сжимается обратно до JOURNAL_INITIAL_RECORDS.
+
+enum {
+    JOURNAL_CHECKPOINT_EVERY = 1024,  ///< записей изменений между контрольными точками
+    JOURNAL_INITIAL_RECORDS = 4096
+};
+
+typedef enum {
+    JOURNAL_END = 0,         ///< неписаная или оборванная запись
+    JOURNAL_CHANGE,          ///< новый баланс счета
+    JOURNAL_SNAPSHOT,        ///< баланс счета в контрольной точке
+    JOURNAL_CHECKPOINT,      ///< контрольная точка завершена
+    JOURNAL_ACCEPT           ///< принят перевод: account - origin, balance и time - младшие и старшие 16 бит seq
+} JournalKind;
+
+typedef struct {
+    uint8_t     kind;        ///< пишется последним (release): до этого запись не видна
+    local_id    account;
+    balance_t   balance;
+    timestamp_t time;
+    uint16_t    check;       ///< контроль от частично записанных страниц
+} __attribute__((packed)) JournalRecord;
+
+typedef struct JournalHeader JournalHeader;
+
+typedef struct {
+    int fd;
+    char *map;
+    size_t map_len;
+    JournalHeader *header;
+    JournalRecord *records;
+    size_t capacity;
+    size_t len;              ///< записей до конца журнала
+    size_t since_checkpoint;
+} Journal;
+
+/** Открыть или создать журнал шарда [first, first + count).
+ *
+ * @return 1 если в журнале есть контрольная точка для восстановления,
+ *         0 если журнал новый, -1 при ошибке или журнале другого шарда
+ */
+int journal_open(Journal *journal, const char *path, local_id first, int count);
+void journal_close(Journal *journal);
+
+/** Дописать запись.
+ *
+ * @return 0 on success, -1 если журнал не удалось увеличить. Запись тогда
+ *         потеряна, и журнал помечается неполным: journal_open() откажется
+ *         восстанавливать из него шард
+ */
+int journal_append(Journal *journal, JournalKind kind, local_id account,
+                   balance_t balance, timestamp_t time);
+
+/** Номер перевода в запись JOURNAL_ACCEPT.
+ */
+int journal_accept(Journal *journal, const TransferId *id);
+
+/** Номер перевода из записи JOURNAL_ACCEPT.
+ */
+TransferId journal_record_id(const JournalRecord *record);
+
+/** Записать снимок balances[0..count) и принятых номеров dedup (может быть
+ * NULL), сделать его точкой восстановления и перенести в начало файла.
+ *
+ * @return 0 on success, -1 если снимок не удалось записать
+ */
+int journal_checkpoint(Journal *journal, const balance_t *balances, const DedupTable *dedup,
+                       timestamp_t time);
+
+static inline int journal_checkpoint_due(const Journal *journal) {
+    return journal->since_checkpoint >= JOURNAL_CHECKPOINT_EVERY;
+}
+
+/** Записи от последней контрольной точки до конца журнала.
+ *
+ * @return число записей в *records
+ */
+size_t journal_tail(const Journal *journal, const JournalRecord **records);
+
+#endif // JOURNAL_H
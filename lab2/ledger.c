@@ -0,0 +1,305 @@
+#include "ledger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+void ledger_shard(int accounts, int workers, local_id worker, local_id *first, int *count) {
+    // Первые accounts % workers шардов на один счет длиннее
+    int base = accounts / workers;
+    int extra = accounts % workers;
+    int index = worker - 1;
+
+    *first = (local_id)(1 + index * base + (index < extra ? index : extra));
+    *count = base + (index < extra ? 1 : 0);
+}
+
+local_id ledger_owner(int accounts, int workers, local_id account) {
+    int base = accounts / workers;
+    int extra = accounts % workers;
+    int index = account - 1;
+
+    // В первых extra шардах по base + 1 счету
+    if (index < extra * (base + 1)) {
+        return (local_id)(1 + index / (base + 1));
+    }
+    return (local_id)(1 + extra + (index - extra * (base + 1)) / base);
+}
+
+// Запись в журнал не удалась: журнал помечен неполным (journal_append()),
+// шард продолжает работу без него
+static void journal_failed(Ledger *ledger) {
+    fprintf(stderr, "shard %d..%d: journal write failed, changes are no longer journaled\n",
+            ledger->first, ledger->first + ledger->count - 1);
+    journal_close(ledger->journal);
+    free(ledger->journal);
+    ledger->journal = NULL;
+}
+
+static void history_append(Ledger *ledger, local_id account, balance_t balance, timestamp_t now) {
+    if (ledger->hist_len == ledger->hist_cap) {
+        size_t cap = ledger->hist_cap ? ledger->hist_cap * 2 : 64;
+        local_id *accounts = realloc(ledger->hist_account, cap * sizeof(local_id));
+        balance_t *balances = realloc(ledger->hist_balance, cap * sizeof(balance_t));
+        timestamp_t *times = realloc(ledger->hist_time, cap * sizeof(timestamp_t));
+        if (!accounts || !balances || !times) {
+            perror("realloc ledger history failed");
+            exit(1);
+        }
+        ledger->hist_account = accounts;
+        ledger->hist_balance = balances;
+        ledger->hist_time = times;
+        ledger->hist_cap = cap;
+    }
+
+    ledger->hist_account[ledger->hist_len] = account;
+    ledger->hist_balance[ledger->hist_len] = balance;
+    ledger->hist_time[ledger->hist_len] = now;
+    ledger->hist_len++;
+
+    if (ledger->journal && journal_append(ledger->journal, JOURNAL_CHANGE, account, balance, now) != 0) {
+        journal_failed(ledger);
+    }
+}
+
+void ledger_init(Ledger *ledger, local_id first, int count, const balance_t *initial, timestamp_t now) {
+    memset(ledger, 0, sizeof(Ledger));
+    dedup_init(&ledger->dedup);
+    ledger->first = first;
+    ledger->count = count;
+
+    ledger->balance = malloc(count * sizeof(balance_t));
+    ledger->updated = malloc(count * sizeof(timestamp_t));
+    if (!ledger->balance || !ledger->updated) {
+        perror("malloc ledger failed");
+        exit(1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        ledger->balance[i] = initial[i];
+        ledger->updated[i] = now;
+        history_append(ledger, (local_id)(first + i), initial[i], now);
+    }
+}
+
+int ledger_attach_journal(Ledger *ledger, const char *path, timestamp_t now) {
+    Journal *journal = malloc(sizeof(Journal));
+    if (!journal) {
+        perror("malloc journal failed");
+        exit(1);
+    }
+
+    int rc = journal_open(journal, path, ledger->first, ledger->count);
+    if (rc < 0) {
+        free(journal);
+        return -1;
+    }
+
+    if (rc == 0) {
+        ledger->journal = journal;
+        if (journal_checkpoint(journal, ledger->balance, &ledger->dedup, now) != 0) {
+            journal_failed(ledger);
+            return -1;
+        }
+        return 0;
+    }
+
+    // Восстановление: снимок последней контрольной точки, затем изменения после нее.
+    // Снимок недописанной точки в конце повторяет текущие балансы - пропускаем.
+    // Принятые номера проигрываются все: повторный dedup_accept() окна не меняет
+    const JournalRecord *records;
+    size_t count = journal_tail(journal, &records);
+    int after_checkpoint = 0;
+
+    ledger->hist_len = 0;
+    for (size_t k = 0; k < count; k++) {
+        const JournalRecord *record = &records[k];
+        if (record->kind == JOURNAL_CHECKPOINT) {
+            after_checkpoint = 1;
+            continue;
+        }
+        if (record->kind == JOURNAL_ACCEPT) {
+            TransferId id = journal_record_id(record);
+            dedup_accept(&ledger->dedup, &id);
+            continue;
+        }
+        if ((record->kind == JOURNAL_SNAPSHOT && after_checkpoint) || !ledger_owns(ledger, record->account)) {
+            continue;
+        }
+
+        int i = record->account - ledger->first;
+        ledger->balance[i] = record->balance;
+        ledger->updated[i] = record->time;
+        history_append(ledger, record->account, record->balance, record->time);
+    }
+
+    ledger->journal = journal;
+    return 1;
+}
+
+void ledger_free(Ledger *ledger) {
+    if (ledger->journal) {
+        journal_close(ledger->journal);
+        free(ledger->journal);
+    }
+    free(ledger->balance);
+    free(ledger->updated);
+    free(ledger->hist_account);
+    free(ledger->hist_balance);
+    free(ledger->hist_time);
+    memset(ledger, 0, sizeof(Ledger));
+}
+
+static void credit(Ledger *ledger, local_id account, balance_t amount, timestamp_t now) {
+    int i = account - ledger->first;
+    ledger->balance[i] += amount;
+    ledger->updated[i] = now;
+    history_append(ledger, account, ledger->balance[i], now);
+}
+
+// Списать с обеспеченного своего счета и зачислить получателю: своему сразу,
+// чужому через outbox. 1 - зачислено в этом шарде
+static int debit(Ledger *ledger, const TransferOrder *order, const TransferId *id,
+                 int accounts, int workers, timestamp_t now, LedgerOutbox *outbox) {
+    int i = order->s_src - ledger->first;
+    ledger->balance[i] -= order->s_amount;
+    ledger->updated[i] = now;
+    history_append(ledger, order->s_src, ledger->balance[i], now);
+
+    if (!ledger_owns(ledger, order->s_dst)) {
+        local_id owner = ledger_owner(accounts, workers, order->s_dst);
+        outbox->orders[owner][outbox->count[owner]] = *order;
+        outbox->ids[owner][outbox->count[owner]++] = *id;
+        return 0;
+    }
+
+    credit(ledger, order->s_dst, order->s_amount, now);
+    return 1;
+}
+
+// Зачисление на account могло обеспечить отложенные с него переводы.
+// С одного счета они списываются по очереди: следующий ждет предыдущего
+static void release_pending(Ledger *ledger, local_id account, int accounts, int workers,
+                            timestamp_t now, LedgerOutbox *outbox, BatchAck *ack) {
+    int p = 0;
+    while (p < ledger->pending_count) {
+        if (ledger->pending[p].s_src != account) {
+            p++;
+            continue;
+        }
+        if (ledger->balance[account - ledger->first] < ledger->pending[p].s_amount) {
+            return;
+        }
+
+        TransferOrder order = ledger->pending[p];
+        TransferId id = ledger->pending_id[p];
+        ledger->pending_count--;
+        memmove(&ledger->pending[p], &ledger->pending[p + 1], (ledger->pending_count - p) * sizeof(TransferOrder));
+        memmove(&ledger->pending_id[p], &ledger->pending_id[p + 1], (ledger->pending_count - p) * sizeof(TransferId));
+        ack->released++;
+
+        if (debit(ledger, &order, &id, accounts, workers, now, outbox)) {
+            ack->applied++;
+            release_pending(ledger, order.s_dst, accounts, workers, now, outbox, ack);
+        }
+        // Рекурсия могла сдвинуть очередь - смотрим сначала
+        p = 0;
+    }
+}
+
+void ledger_set_pending(Ledger *ledger, int limit) {
+    ledger->pending_limit = limit < LEDGER_MAX_PENDING ? limit : LEDGER_MAX_PENDING;
+}
+
+int ledger_cancel_pending(Ledger *ledger, LedgerOutbox *outbox) {
+    int count = ledger->pending_count;
+    for (int p = 0; p < count; p++) {
+        outbox->rejected[outbox->rejected_count++] = ledger->pending_id[p];
+    }
+    ledger->pending_count = 0;
+    return count;
+}
+
+BatchAck ledger_apply(Ledger *ledger, const TransferOrder *orders, const TransferId *ids, int count,
+                      int accounts, int workers, timestamp_t now, LedgerOutbox *outbox) {
+    BatchAck ack = { 0, 0, 0, 0 };
+
+    for (int k = 0; k < count; k++) {
+        const TransferOrder *order = &orders[k];
+        int owns_src = ledger_owns(ledger, order->s_src);
+
+        // Чужой перевод - не наш шард
+        if (!owns_src && !ledger_owns(ledger, order->s_dst)) {
+            continue;
+        }
+        // Номер отмечается до исхода: отклоненный перевод при повторе тоже не применяется
+        if (!dedup_accept(&ledger->dedup, &ids[k])) {
+            ack.duplicate++;
+            continue;
+        }
+        // Номер в журнале раньше изменений: после сбоя между ними перевод
+        // потеряется, но не применится дважды
+        if (ids[k].seq != 0 && ledger->journal && journal_accept(ledger->journal, &ids[k]) != 0) {
+            journal_failed(ledger);
+        }
+
+        if (owns_src) {
+            if (ledger->balance[order->s_src - ledger->first] < order->s_amount) {
+                if (ledger->pending_count < ledger->pending_limit) {
+                    ledger->pending[ledger->pending_count] = *order;
+                    ledger->pending_id[ledger->pending_count++] = ids[k];
+                    ack.held++;
+                } else {
+                    outbox->rejected[outbox->rejected_count++] = ids[k];
+                }
+                continue;
+            }
+            if (!debit(ledger, order, &ids[k], accounts, workers, now, outbox)) {
+                continue;
+            }
+        } else {
+            credit(ledger, order->s_dst, order->s_amount, now);
+        }
+
+        ack.applied++;
+        release_pending(ledger, order->s_dst, accounts, workers, now, outbox, &ack);
+    }
+
+    // Контрольная точка ограничивает, сколько журнала проигрывать при восстановлении
+    if (ledger->journal && journal_checkpoint_due(ledger->journal) &&
+        journal_checkpoint(ledger->journal, ledger->balance, &ledger->dedup, now) != 0) {
+        journal_failed(ledger);
+    }
+
+    return ack;
+}
+
+balance_t ledger_total(const Ledger *ledger) {
+    balance_t total = 0;
+    for (int i = 0; i < ledger->count; i++) {
+        total += ledger->balance[i];
+    }
+    return total;
+}
+
+void ledger_history(const Ledger *ledger, local_id account, BalanceHistory *history) {
+    // s_history_len - uint8_t, так что состояний не больше 255. Изменения
+    // в один момент времени сливаются, при переполнении последнее состояние
+    // заменяется - итоговый баланс в истории есть всегда
+    int len = 0;
+    for (size_t k = 0; k < ledger->hist_len; k++) {
+        if (ledger->hist_account[k] != account) {
+            continue;
+        }
+        if (len > 0 && (history->s_history[len - 1].s_time == ledger->hist_time[k] || len == MAX_T)) {
+            len--;
+        }
+        BalanceState *state = &history->s_history[len++];
+        state->s_balance = ledger->hist_balance[k];
+        state->s_time = ledger->hist_time[k];
+        state->s_balance_pending_in = 0;
+    }
+
+    history->s_id = account;
+    history->s_history_len = (uint8_t)len;
+}
@@ -0,0 +1,133 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include "banking.h"
+#include "journal.h"
+#include "dedup.h"
+#include "ipc_frame.h"
+#include <stddef.h>
+#include <string.h>
+
+// Шардированная книга счетов: процесс-работник владеет непрерывным
+// диапазоном счетов, и число счетов больше не равно числу процессов.
+// Балансы хранятся столбцами (structure of arrays): проход по пачке
+// переводов трогает только нужные столбцы. История изменений - общий
+// журнал шарда, тоже столбцами; BalanceHistory счета собирается из него
+// по запросу.
+//
+// Номера счетов - local_id из TransferOrder, поэтому их не больше 127.
+
+enum {
+    LEDGER_MAX_ACCOUNTS = 127,
+    /// Сколько переводов (TransferOrder и TransferId) помещается в одно сообщение TRANSFER,
+    /// даже если send() добавит к нему метку времени и CRC
+    LEDGER_MAX_BATCH = MAX_EXT_PAYLOAD_LEN / (sizeof(TransferOrder) + sizeof(TransferId)),
+    /// Сколько необеспеченных переводов шард может держать в ожидании денег
+    LEDGER_MAX_PENDING = 64,
+    /// Пачка плюс все освобожденные отложенные: больше переводов одна пачка не выпустит
+    LEDGER_MAX_OUTBOX = LEDGER_MAX_BATCH + LEDGER_MAX_PENDING
+};
+
+typedef struct {
+    local_id first;           ///< первый счет шарда (счета нумеруются с 1)
+    int count;
+    balance_t *balance;       ///< balance[i] - счет first + i
+    timestamp_t *updated;     ///< время последнего изменения
+
+    // Журнал изменений: запись k - счет, новый баланс, время
+    local_id *hist_account;
+    balance_t *hist_balance;
+    timestamp_t *hist_time;
+    size_t hist_len;
+    size_t hist_cap;
+
+    Journal *journal;         ///< журнал на диске, NULL если не подключен
+    DedupTable dedup;         ///< номера уже принятых переводов
+
+    // Переводы, ждущие зачисления на счет-источник, в порядке поступления
+    TransferOrder pending[LEDGER_MAX_PENDING];
+    TransferId pending_id[LEDGER_MAX_PENDING];
+    int pending_count;
+    int pending_limit;        ///< 0 - необеспеченный перевод сразу отклоняется
+} Ledger;
+
+/// Итог применения пачки. Кредиты чужих счетов и отклоненные переводы уходят в outbox.
+typedef struct {
+    uint16_t applied;   ///< зачислено на счета этого шарда
+    uint16_t duplicate; ///< повтор уже принятого перевода, не применялся
+    uint16_t held;      ///< не хватило денег, перевод ждет зачисления
+    uint16_t released;  ///< ранее отложенных переводов списано
+} __attribute__((packed)) BatchAck;
+
+/// Переводы для других шардов по номеру работника-владельца и номера отклоненных.
+/// Переводов одному владельцу может быть больше LEDGER_MAX_BATCH - шлются частями
+typedef struct {
+    TransferOrder orders[MAX_PROCESS_ID + 1][LEDGER_MAX_OUTBOX];
+    TransferId ids[MAX_PROCESS_ID + 1][LEDGER_MAX_OUTBOX];
+    int count[MAX_PROCESS_ID + 1];
+    TransferId rejected[LEDGER_MAX_OUTBOX];
+    int rejected_count;
+} LedgerOutbox;
+
+static inline void ledger_outbox_reset(LedgerOutbox *outbox) {
+    memset(outbox->count, 0, sizeof(outbox->count));
+    outbox->rejected_count = 0;
+}
+
+/** Шард работника worker (1..workers) из accounts счетов: счета [*first, *first + *count).
+ */
+void ledger_shard(int accounts, int workers, local_id worker, local_id *first, int *count);
+
+/** Номер работника, которому принадлежит счет.
+ */
+local_id ledger_owner(int accounts, int workers, local_id account);
+
+/** Создать шард; initial[i] - начальный баланс счета first + i.
+ */
+void ledger_init(Ledger *ledger, local_id first, int count, const balance_t *initial, timestamp_t now);
+void ledger_free(Ledger *ledger);
+
+static inline int ledger_owns(const Ledger *ledger, local_id account) {
+    return account >= ledger->first && account < ledger->first + ledger->count;
+}
+
+/** Применить пачку за один проход.
+ *
+ * Списание со своего счета выполняется, если хватает денег. Иначе перевод
+ * откладывается до зачисления на этот счет (см. ledger_set_pending()) или
+ * отклоняется - его номер попадает в outbox->rejected. Зачисление на свой
+ * счет выполняется сразу и пробует списать отложенные с него переводы, на чужой -
+ * перевод добавляется в outbox для владельца с тем же ids[k]. Перевод,
+ * пришедший от другого шарда, уже списан и только зачисляется. Повторно
+ * пришедший перевод (тот же ids[k]) не применяется и считается в duplicate.
+ */
+BatchAck ledger_apply(Ledger *ledger, const TransferOrder *orders, const TransferId *ids, int count,
+                      int accounts, int workers, timestamp_t now, LedgerOutbox *outbox);
+
+/** Разрешить держать до limit необеспеченных переводов (0 - не держать).
+ */
+void ledger_set_pending(Ledger *ledger, int limit);
+
+/** Отклонить все отложенные переводы: их номера уходят в outbox->rejected.
+ *
+ * @return число отклоненных
+ */
+int ledger_cancel_pending(Ledger *ledger, LedgerOutbox *outbox);
+
+/** Подключить журнал: если в нем есть контрольная точка, балансы и история
+ * шарда восстанавливаются из него, иначе в него пишется текущее состояние.
+ *
+ * @return 1 восстановлено, 0 журнал новый, -1 ошибка (шард работает без журнала)
+ */
+int ledger_attach_journal(Ledger *ledger, const char *path, timestamp_t now);
+
+/** Сумма балансов шарда.
+ */
+balance_t ledger_total(const Ledger *ledger);
+
+/** История одного счета шарда: одно состояние на момент времени,
+ * не длиннее MAX_T, последним всегда идет текущий баланс.
+ */
+void ledger_history(const Ledger *ledger, local_id account, BalanceHistory *history);
+
+#endif // LEDGER_H
@@ -0,0 +1,32 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "banking.h"
+
+// Переводы родителя с результатом (bank_robbery.c). transfer() из banking.h
+// возвращает void, поэтому исход доступен только через эти функции.
+
+typedef enum {
+    TRANSFER_OK = 0,       ///< деньги зачислены (или перевод уже был принят раньше)
+    TRANSFER_REJECTED,     ///< на счете-источнике не хватило денег
+    TRANSFER_FAILED        ///< участник умер (исход неизвестен) или перевод не удалось отправить
+} TransferStatus;
+
+/** Пачка переводов с ожиданием ответа на каждый.
+ *
+ * Отклоненный перевод сразу возвращается родителю сообщением TRANSFER_NACK
+ * с его номером. Переводы, отложенные шардами до поступления денег
+ * (LEDGER_PENDING), отменяются, как только ждать их больше нечего.
+ * Пачка может быть любой длины: больше LEDGER_MAX_BATCH переводов
+ * отправляются частями.
+ *
+ * @param status Массив из count исходов (может быть NULL)
+ *
+ * @return число отклоненных переводов или -1, если участник умер или
+ *         часть пачки не удалось отправить
+ */
+int transfer_batch(void * parent_data, const TransferOrder * orders, int count, TransferStatus * status);
+
+TransferStatus transfer_checked(void * parent_data, local_id src, local_id dst, balance_t amount);
+
+#endif // TRANSFER_H
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "workload.h"
+#include "clock.h"
+#include "ledger.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// xorshift64*: воспроизводимо по seed и быстрее rand()
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double next_unit(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int workload_parse(const char *spec, WorkloadConfig *config) {
+    config->transfers = 1000;
+    config->dist = WORKLOAD_UNIFORM;
+    config->zipf_s = 1.0;
+    config->amount_min = 1;
+    config->amount_max = 10;
+    config->batch = 1;
+    config->seed = 1;
+
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    char *saveptr;
+    for (char *item = strtok_r(buf, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(item, '=');
+        if (!value) {
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (strcmp(item, "transfers") == 0) {
+            config->transfers = atoi(value);
+        } else if (strcmp(item, "dist") == 0) {
+            if (strcmp(value, "uniform") == 0) {
+                config->dist = WORKLOAD_UNIFORM;
+            } else if (strncmp(value, "zipf", 4) == 0) {
+                config->dist = WORKLOAD_ZIPF;
+                if (value[4] == ':') {
+                    config->zipf_s = atof(value + 5);
+                }
+            } else {
+                return -1;
+            }
+        } else if (strcmp(item, "amount") == 0) {
+            char *dash = strchr(value, '-');
+            config->amount_min = (balance_t)atoi(value);
+            config->amount_max = dash ? (balance_t)atoi(dash + 1) : config->amount_min;
+        } else if (strcmp(item, "batch") == 0) {
+            config->batch = atoi(value);
+        } else if (strcmp(item, "seed") == 0) {
+            config->seed = strtoull(value, NULL, 10);
+        } else {
+            return -1;
+        }
+    }
+
+    if (config->transfers < 0 || config->batch < 1 || config->batch > LEDGER_MAX_BATCH ||
+        config->amount_min < 1 || config->amount_max < config->amount_min || config->zipf_s <= 0) {
+        return -1;
+    }
+    // Нулевое состояние xorshift так и остается нулем
+    if (config->seed == 0) {
+        config->seed = 1;
+    }
+    return 0;
+}
+
+// Функция распределения счетов: cdf[k] - вероятность выбрать счет <= k + 1
+static void build_cdf(const WorkloadConfig *config, int accounts, double *cdf) {
+    double sum = 0;
+    for (int k = 0; k < accounts; k++) {
+        sum += config->dist == WORKLOAD_ZIPF ? 1.0 / pow(k + 1, config->zipf_s) : 1.0;
+        cdf[k] = sum;
+    }
+    for (int k = 0; k < accounts; k++) {
+        cdf[k] /= sum;
+    }
+}
+
+static local_id pick_account(const double *cdf, int accounts, uint64_t *state) {
+    double u = next_unit(state);
+    int lo = 0;
+    int hi = accounts - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (local_id)(lo + 1);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int workload_run(void *parent_data, int accounts, const WorkloadConfig *config,
+                 WorkloadReport *report) {
+    memset(report, 0, sizeof(*report));
+    if (accounts < 2) {
+        return config->transfers == 0 ? 0 : -1;
+    }
+
+    double cdf[LEDGER_MAX_ACCOUNTS];
+    build_cdf(config, accounts, cdf);
+
+    int max_batches = (config->transfers + config->batch - 1) / config->batch;
+    uint64_t *latency = malloc((max_batches ? max_batches : 1) * sizeof(uint64_t));
+    if (!latency) {
+        perror("malloc workload latencies failed");
+        exit(1);
+    }
+
+    uint64_t state = config->seed;
+    TransferOrder orders[LEDGER_MAX_BATCH];
+    uint64_t start = clock_now_ns();
+    int rc = 0;
+
+    while (report->transfers < config->transfers) {
+        int count = config->transfers - report->transfers;
+        if (count > config->batch) {
+            count = config->batch;
+        }
+
+        // Генерация до замера: в задержку входит только обмен сообщениями
+        for (int k = 0; k < count; k++) {
+            TransferOrder *order = &orders[k];
+            order->s_src = pick_account(cdf, accounts, &state);
+            do {
+                order->s_dst = pick_account(cdf, accounts, &state);
+            } while (order->s_dst == order->s_src);
+            uint32_t span = (uint32_t)(config->amount_max - config->amount_min) + 1;
+            order->s_amount = (balance_t)(config->amount_min + next_random(&state) % span);
+        }
+
+        uint64_t sent = clock_now_ns();
+        int rejected = transfer_batch(parent_data, orders, count, NULL);
+        latency[report->batches++] = clock_now_ns() - sent;
+        if (rejected < 0) {
+            rc = -1;
+            break;
+        }
+        report->transfers += count;
+        report->rejected += rejected;
+    }
+
+    report->elapsed_ns = clock_now_ns() - start;
+    if (report->batches > 0) {
+        qsort(latency, report->batches, sizeof(uint64_t), compare_u64);
+        report->latency_p50_ns = latency[(report->batches - 1) / 2];
+        report->latency_p99_ns = latency[(report->batches - 1) * 99 / 100];
+        report->latency_max_ns = latency[report->batches - 1];
+    }
+
+    free(latency);
+    return rc;
+}
+
+int workload_conserved(const AllHistory *history, long expected) {
+    long total = 0;
+    for (int i = 0; i < history->s_history_len; i++) {
+        const BalanceHistory *h = &history->s_history[i];
+        if (h->s_history_len > 0) {
+            total += h->s_history[h->s_history_len - 1].s_balance;
+        }
+    }
+    return total == expected;
+}
+
+void workload_print_report(FILE *out, const WorkloadReport *report) {
+    double seconds = report->elapsed_ns / 1e9;
+    fprintf(out, "workload: %d transfers (%d rejected) in %d batches, %.3f s, %.0f transfers/s\n",
+            report->transfers, report->rejected, report->batches, seconds,
+            seconds > 0 ? report->transfers / seconds : 0.0);
+    fprintf(out, "workload: batch latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            report->latency_p50_ns / 1e3, report->latency_p99_ns / 1e3, report->latency_max_ns / 1e3);
+}
@@ -0,0 +1,58 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "banking.h"
+#include "transfer.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Генератор нагрузки вместо фиксированного кольца bank_robbery():
+// случайные переводы с заданным распределением счетов и сумм, пачками
+// по batch переводов в полете. Включается переменной окружения WORKLOAD
+// со строкой вида "transfers=10000,dist=zipf:1.1,amount=1-10,batch=16,seed=7".
+
+typedef enum {
+    WORKLOAD_UNIFORM = 0,
+    WORKLOAD_ZIPF             ///< счет k выбирается с весом 1 / k^zipf_s
+} WorkloadDist;
+
+typedef struct {
+    int transfers;            ///< всего переводов
+    WorkloadDist dist;        ///< распределение счетов-источников и получателей
+    double zipf_s;
+    balance_t amount_min;     ///< сумма равномерно из [amount_min, amount_max]
+    balance_t amount_max;
+    int batch;                ///< переводов в одной пачке transfer_batch()
+    uint64_t seed;
+} WorkloadConfig;
+
+typedef struct {
+    int transfers;
+    int rejected;             ///< отклонено из-за нехватки денег
+    int batches;
+    uint64_t elapsed_ns;
+    uint64_t latency_p50_ns;  ///< задержка пачки: от отправки до последнего ACK
+    uint64_t latency_p99_ns;
+    uint64_t latency_max_ns;
+} WorkloadReport;
+
+/** Разобрать строку настроек; незаданные поля получают значения по умолчанию.
+ *
+ * @return 0 on success, -1 если строка некорректна
+ */
+int workload_parse(const char * spec, WorkloadConfig * config);
+
+/** Выполнить нагрузку над счетами 1..accounts.
+ *
+ * @return 0 on success, -1 если нагрузка прервана
+ */
+int workload_run(void * parent_data, int accounts, const WorkloadConfig * config,
+                 WorkloadReport * report);
+
+/** Сохранились ли деньги: сумма последних балансов историй равна expected.
+ */
+int workload_conserved(const AllHistory * history, long expected);
+
+void workload_print_report(FILE * out, const WorkloadReport * report);
+
+#endif // WORKLOAD_H